@@ -0,0 +1,86 @@
+# Checks that the block type stats of a scene of adaptive textures add up
+# to the cache totals of every access pattern, with a victim cache and
+# sectored lines so that every kind of line access shows up.
+#
+#   cmake -DCACHE_SIM=<path to cache-sim> -DTESTDATA=<testdata dir> -P CheckBlockTypeStats.cmake
+
+IF(NOT CACHE_SIM OR NOT TESTDATA)
+  MESSAGE(FATAL_ERROR "CACHE_SIM and TESTDATA must be set")
+ENDIF()
+
+EXECUTE_PROCESS(COMMAND ${CACHE_SIM} --block-type-stats --victim-entries=8 --sector-size=32
+                        scene 12x12 ${TESTDATA}/adaptive12x12.txt ${TESTDATA}/adaptive.png
+                              4x4 ${TESTDATA}/adaptive4x4.txt ${TESTDATA}/adaptive.png
+                OUTPUT_VARIABLE OUTPUT)
+
+# A table row is the type name followed by eleven counts and the share of
+# misses...
+SET(ROW_REGEX "")
+FOREACH(I RANGE 10)
+  SET(ROW_REGEX "${ROW_REGEX} +[0-9]+")
+ENDFOREACH()
+SET(ROW_REGEX "${ROW_REGEX} +[0-9.]+\n")
+
+# One section per access pattern...
+STRING(REPLACE ";" "," OUTPUT "${OUTPUT}")
+STRING(REPLACE "Cache stats for " ";" SECTIONS "${OUTPUT}")
+LIST(REMOVE_AT SECTIONS 0)
+LIST(LENGTH SECTIONS NUM_SECTIONS)
+IF(NUM_SECTIONS EQUAL 0)
+  MESSAGE(FATAL_ERROR "No cache stats in the output:\n${OUTPUT}")
+ENDIF()
+
+FOREACH(SECTION ${SECTIONS})
+  STRING(REGEX MATCH "^[^\n]*" NAME "${SECTION}")
+  SET(EXPECTED "")
+  FOREACH(STAT "Num cache accesses" "Num cache hits" "Num cache misses"
+               "Num victim cache hits" "Num sector misses" "Bytes filled from memory")
+    STRING(REGEX MATCH "${STAT}: ([0-9]+)" MATCH "${SECTION}")
+    IF(NOT MATCH)
+      MESSAGE(FATAL_ERROR "No \"${STAT}\" for ${NAME}")
+    ENDIF()
+    LIST(APPEND EXPECTED ${CMAKE_MATCH_1})
+  ENDFOREACH()
+
+  # Metadata and payload columns: lines, hits, misses, victim hits, bytes...
+  SET(LINES 0)
+  SET(HITS 0)
+  SET(MISSES 0)
+  SET(VICTIM_HITS 0)
+  SET(BYTES 0)
+  STRING(REGEX MATCHALL "${ROW_REGEX}" ROWS "${SECTION}")
+  IF(NOT ROWS)
+    MESSAGE(FATAL_ERROR "No block type stats for ${NAME}")
+  ENDIF()
+  FOREACH(ROW ${ROWS})
+    STRING(REGEX MATCHALL "[0-9]+" COUNTS "${ROW}")
+    FOREACH(PART 1 6)
+      MATH(EXPR HITS_AT "${PART} + 1")
+      MATH(EXPR MISSES_AT "${PART} + 2")
+      MATH(EXPR VICTIM_HITS_AT "${PART} + 3")
+      MATH(EXPR BYTES_AT "${PART} + 4")
+      LIST(GET COUNTS ${PART} ${HITS_AT} ${MISSES_AT} ${VICTIM_HITS_AT} ${BYTES_AT} PART_COUNTS)
+      LIST(GET PART_COUNTS 0 PART_LINES)
+      LIST(GET PART_COUNTS 1 PART_HITS)
+      LIST(GET PART_COUNTS 2 PART_MISSES)
+      LIST(GET PART_COUNTS 3 PART_VICTIM_HITS)
+      LIST(GET PART_COUNTS 4 PART_BYTES)
+      MATH(EXPR LINES "${LINES} + ${PART_LINES}")
+      MATH(EXPR HITS "${HITS} + ${PART_HITS}")
+      MATH(EXPR MISSES "${MISSES} + ${PART_MISSES}")
+      MATH(EXPR VICTIM_HITS "${VICTIM_HITS} + ${PART_VICTIM_HITS}")
+      MATH(EXPR BYTES "${BYTES} + ${PART_BYTES}")
+    ENDFOREACH()
+  ENDFOREACH()
+
+  # The lines that are neither hits, misses nor victim hits are sector
+  # misses...
+  MATH(EXPR SECTOR_MISSES "${LINES} - ${HITS} - ${MISSES} - ${VICTIM_HITS}")
+  SET(ACTUAL ${LINES} ${HITS} ${MISSES} ${VICTIM_HITS} ${SECTOR_MISSES} ${BYTES})
+  IF(NOT "${EXPECTED}" STREQUAL "${ACTUAL}")
+    MESSAGE(FATAL_ERROR "Block type stats don't add up for ${NAME}\n"
+                        "  (accesses, hits, misses, victim hits, sector misses, bytes filled)\n"
+                        "  cache:       ${EXPECTED}\n"
+                        "  block types: ${ACTUAL}")
+  ENDIF()
+ENDFOREACH()
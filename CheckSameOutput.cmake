@@ -0,0 +1,29 @@
+# Checks that cache-sim prints exactly the same results with two sets of
+# options, e.g. that a parallel run matches the serial one.
+#
+#   cmake -DCACHE_SIM=<path to cache-sim> -DOPTIONS=<options> -DOTHER_OPTIONS=<options>
+#         -DINPUTS=<texture or scene> -P CheckSameOutput.cmake
+#
+# OPTIONS, OTHER_OPTIONS and INPUTS are space-separated.
+
+IF(NOT CACHE_SIM OR NOT OPTIONS OR NOT OTHER_OPTIONS OR NOT INPUTS)
+  MESSAGE(FATAL_ERROR "CACHE_SIM, OPTIONS, OTHER_OPTIONS and INPUTS must be set")
+ENDIF()
+
+SEPARATE_ARGUMENTS(OPTION_LIST UNIX_COMMAND "${OPTIONS}")
+SEPARATE_ARGUMENTS(OTHER_OPTION_LIST UNIX_COMMAND "${OTHER_OPTIONS}")
+SEPARATE_ARGUMENTS(INPUT_LIST UNIX_COMMAND "${INPUTS}")
+
+EXECUTE_PROCESS(COMMAND ${CACHE_SIM} ${OPTION_LIST} ${INPUT_LIST}
+                OUTPUT_VARIABLE EXPECTED ERROR_VARIABLE EXPECTED_ERRORS)
+EXECUTE_PROCESS(COMMAND ${CACHE_SIM} ${OTHER_OPTION_LIST} ${INPUT_LIST}
+                OUTPUT_VARIABLE ACTUAL ERROR_VARIABLE ACTUAL_ERRORS)
+
+IF(NOT EXPECTED MATCHES "Cache stats for" OR NOT ACTUAL MATCHES "Cache stats for")
+  MESSAGE(FATAL_ERROR "cache-sim didn't run:\n${EXPECTED_ERRORS}${ACTUAL_ERRORS}")
+ENDIF()
+
+IF(NOT "${EXPECTED}" STREQUAL "${ACTUAL}")
+  MESSAGE(FATAL_ERROR "Output with ${OTHER_OPTIONS} differs from ${OPTIONS}.\n"
+                      "With ${OPTIONS}:\n${EXPECTED}\nWith ${OTHER_OPTIONS}:\n${ACTUAL}")
+ENDIF()
@@ -0,0 +1,34 @@
+# Checks that sweeping a single cache configuration gives the same hits
+# and misses as simulating it directly, with the decoded block cache on
+# so that samples are split across replay chunks.
+#
+#   cmake -DCACHE_SIM=<path to cache-sim> -P CheckSweep.cmake
+
+IF(NOT CACHE_SIM)
+  MESSAGE(FATAL_ERROR "CACHE_SIM must be set")
+ENDIF()
+
+SET(ARGS --decoded-texels=1024 scene ASTC12x12 600 600 ASTC8x8 600 600 ASTC4x4 600 600)
+
+EXECUTE_PROCESS(COMMAND ${CACHE_SIM} ${ARGS} OUTPUT_VARIABLE SINGLE)
+EXECUTE_PROCESS(COMMAND ${CACHE_SIM} --sweep-kb=1 ${ARGS} OUTPUT_VARIABLE SWEPT)
+
+# Hits and misses of every access pattern, in order...
+STRING(REGEX MATCHALL "Num cache (hits|misses): [0-9]+" SINGLE_COUNTS "${SINGLE}")
+SET(EXPECTED "")
+FOREACH(COUNT ${SINGLE_COUNTS})
+  STRING(REGEX REPLACE "[^0-9]*([0-9]+)" "\\1" COUNT "${COUNT}")
+  LIST(APPEND EXPECTED ${COUNT})
+ENDFOREACH()
+
+STRING(REGEX MATCHALL "\n +1 +64 +[0-9]+ +[0-9]+" SWEPT_ROWS "${SWEPT}")
+SET(ACTUAL "")
+FOREACH(ROW ${SWEPT_ROWS})
+  STRING(REGEX REPLACE "\n +1 +64 +([0-9]+) +([0-9]+)" "\\1;\\2" ROW "${ROW}")
+  LIST(APPEND ACTUAL ${ROW})
+ENDFOREACH()
+
+LIST(LENGTH EXPECTED NUM_EXPECTED)
+IF(NUM_EXPECTED EQUAL 0 OR NOT "${EXPECTED}" STREQUAL "${ACTUAL}")
+  MESSAGE(FATAL_ERROR "Sweep doesn't match the single run:\n  single: ${EXPECTED}\n  swept:  ${ACTUAL}")
+ENDIF()
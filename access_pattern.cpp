@@ -1,11 +1,20 @@
 #include "access_pattern.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
 
+#include "cache.h"
+#include "curve.h"
+#include "profiler.h"
+#include "random.h"
+#include "scene.h"
 #include "texture.h"
 
 class RasterAccessPattern : public AccessPattern {
- protected:
+ public:
   virtual std::vector<std::pair<int, int> >
   GenerateSamples(int w, int h) const {
     std::vector< std::pair<int, int> > samples;
@@ -16,74 +25,614 @@ class RasterAccessPattern : public AccessPattern {
       }
     }
 
-    return std::move(samples);
+    return samples;
   }
 };
 
-static std::pair<int, int> Deinterleave(int x) {
-  int x1 = 0, x2 = 0;
-  for (size_t i = 0; i < sizeof(int)*8; ++i) {
-    if ((i % 2) == 0) {
-      x1 |= ((x & 0x1) << (i / 2)); 
-    } else {
-      x2 |= ((x & 0x1) << (i / 2)); 
-    }
-    x >>= 1;
+// Collects traversal points into a sample list, optionally offset so that
+// a curve can be laid over one tile of a larger texture.
+struct SampleCollector {
+  SampleCollector(std::vector<std::pair<int, int> > *samples,
+                  int offset_x, int offset_y)
+    : _samples(samples), _offset_x(offset_x), _offset_y(offset_y) { }
+
+  void operator()(int x, int y) {
+    _samples->push_back(std::make_pair(x + _offset_x, y + _offset_y));
   }
-  return std::move(std::make_pair(x1, x2));
-}
+
+  std::vector<std::pair<int, int> > *_samples;
+  const int _offset_x;
+  const int _offset_y;
+};
 
 class MortonAccessPattern : public AccessPattern {
- protected:
+ public:
+  virtual std::vector<std::pair<int, int> >
+  GenerateSamples(int w, int h) const {
+    std::vector< std::pair<int, int> > samples;
+    samples.reserve(w * h);
+
+    SampleCollector collect(&samples, 0, 0);
+    TraverseMorton(w, h, collect);
+    return samples;
+  }
+};
+
+class HilbertAccessPattern : public AccessPattern {
+ public:
+  virtual std::vector<std::pair<int, int> >
+  GenerateSamples(int w, int h) const {
+    std::vector< std::pair<int, int> > samples;
+    samples.reserve(w * h);
+
+    SampleCollector collect(&samples, 0, 0);
+    TraverseHilbert(w, h, collect);
+    return samples;
+  }
+};
+
+// Visits square tiles in raster order and the texels inside each tile in
+// Morton order, the way rasterizers typically walk screen tiles.
+class TiledMortonAccessPattern : public AccessPattern {
+ public:
+  explicit TiledMortonAccessPattern(int tile_size) : _tile_size(tile_size) { }
+
   virtual std::vector<std::pair<int, int> >
   GenerateSamples(int w, int h) const {
     std::vector< std::pair<int, int> > samples;
     samples.reserve(w * h);
-    for (int i = 0; i < w * h; ++i) {
-      samples.push_back(std::move(Deinterleave(i)));
+
+    for (int ty = 0; ty < h; ty += _tile_size) {
+      for (int tx = 0; tx < w; tx += _tile_size) {
+        SampleCollector collect(&samples, tx, ty);
+        TraverseMorton(std::min(_tile_size, w - tx),
+                       std::min(_tile_size, h - ty), collect);
+      }
+    }
+    return samples;
+  }
+
+ private:
+  const int _tile_size;
+};
+
+// Visits every texel once in an order that depends only on the seed.
+class RandomAccessPattern : public AccessPattern {
+ public:
+  explicit RandomAccessPattern(uint64_t seed) : _seed(seed) { }
+
+  virtual std::vector<std::pair<int, int> >
+  GenerateSamples(int w, int h) const {
+    return GenerateFromStream(w, h);
+  }
+
+  virtual std::unique_ptr<SampleStream> Stream(int w, int h) const {
+    return std::unique_ptr<SampleStream>(new RandomStream(_seed, w, h));
+  }
+
+ private:
+  class RandomStream : public SampleStream {
+   public:
+    RandomStream(uint64_t seed, int w, int h)
+      : _rng(seed), _permutation(static_cast<uint64_t>(w) * h, &_rng), _w(w), _next(0) { }
+
+    virtual size_t Next(std::pair<int, int> *samples, size_t max_samples) {
+      const size_t n =
+        static_cast<size_t>(std::min<uint64_t>(max_samples, _permutation.GetSize() - _next));
+      for (size_t i = 0; i < n; ++i) {
+        const uint64_t idx = _permutation[_next++];
+        samples[i] = std::make_pair(static_cast<int>(idx % _w), static_cast<int>(idx / _w));
+      }
+      return n;
     }
 
-    return std::move(samples);
+   private:
+    Xoshiro256 _rng;
+    const RandomPermutation _permutation;
+    const int _w;
+    uint64_t _next;
+  };
+
+  const uint64_t _seed;
+};
+
+// Keeps v in [0, n) by reflecting it off the edges.
+static int Reflect(double v, int n) {
+  const double period = 2.0 * n;
+  v = std::fmod(v, period);
+  if (v < 0.0) {
+    v += period;
+  }
+  if (v >= n) {
+    v = period - v;
+  }
+  return std::min(n - 1, static_cast<int>(v));
+}
+
+static int Clamp(double v, int n) {
+  return static_cast<int>(std::max(0.0, std::min(static_cast<double>(n - 1), std::floor(v + 0.5))));
+}
+
+// A walk from the center of the texture taking random steps in x and y,
+// reflected at the edges.
+class RandomWalkAccessPattern : public AccessPattern {
+ public:
+  RandomWalkAccessPattern(uint64_t seed, double step, EStepDistribution distribution)
+    : _seed(seed), _step(step), _distribution(distribution) { }
+
+  virtual std::vector<std::pair<int, int> >
+  GenerateSamples(int w, int h) const {
+    return GenerateFromStream(w, h);
+  }
+
+  virtual std::unique_ptr<SampleStream> Stream(int w, int h) const {
+    return std::unique_ptr<SampleStream>(new WalkStream(*this, w, h));
   }
+
+ private:
+  class WalkStream : public SampleStream {
+   public:
+    WalkStream(const RandomWalkAccessPattern &pattern, int w, int h)
+      : _pattern(pattern), _w(w), _h(h), _rng(pattern._seed), _x(0.5 * w), _y(0.5 * h)
+      , _num_left(static_cast<size_t>(w) * h) { }
+
+    virtual size_t Next(std::pair<int, int> *samples, size_t max_samples) {
+      const size_t n = std::min(max_samples, _num_left);
+      for (size_t i = 0; i < n; ++i) {
+        samples[i] = std::make_pair(Reflect(_x, _w), Reflect(_y, _h));
+        if (eStepDistribution_Cauchy == _pattern._distribution) {
+          _x += _pattern._step * NextCauchy(&_rng);
+          _y += _pattern._step * NextCauchy(&_rng);
+        } else {
+          _x += _pattern._step * NextGaussian(&_rng);
+          _y += _pattern._step * NextGaussian(&_rng);
+        }
+      }
+      _num_left -= n;
+      return n;
+    }
+
+   private:
+    const RandomWalkAccessPattern &_pattern;
+    const int _w;
+    const int _h;
+    Xoshiro256 _rng;
+    double _x;
+    double _y;
+    size_t _num_left;
+  };
+
+  const uint64_t _seed;
+  const double _step;
+  const EStepDistribution _distribution;
 };
 
-class RandomAccessPattern : public RasterAccessPattern {
- protected:
+// A Morton walk with normally distributed offsets added to each sample.
+class JitteredMortonAccessPattern : public AccessPattern {
+ public:
+  JitteredMortonAccessPattern(uint64_t seed, double jitter) : _seed(seed), _jitter(jitter) { }
+
   virtual std::vector<std::pair<int, int> >
   GenerateSamples(int w, int h) const {
-    std::vector< std::pair<int, int> > samples
-      = std::move(RasterAccessPattern::GenerateSamples(w, h));
+    return GenerateFromStream(w, h);
+  }
 
-    // Shuffle
-    for (size_t i = 0; i < samples.size() - 1; ++i) {
-      size_t x = rand() % (samples.size() - 1 - i) + i;
-      assert(x >= i);
-      std::swap(samples[i], samples[x]);
+  virtual std::unique_ptr<SampleStream> Stream(int w, int h) const {
+    return std::unique_ptr<SampleStream>(new JitterStream(*this, w, h));
+  }
+
+ private:
+  class JitterStream : public SampleStream {
+   public:
+    JitterStream(const JitteredMortonAccessPattern &pattern, int w, int h)
+      : _pattern(pattern), _w(w), _h(h), _cursor(w, h, MortonDecoder()), _next(0) { }
+
+    virtual size_t Next(std::pair<int, int> *samples, size_t max_samples) {
+      size_t n = 0;
+      int x, y;
+      while (n < max_samples && _cursor.Next(&x, &y)) {
+        // Each sample draws its own offsets...
+        CounterGenerator rng(_pattern._seed, _next++);
+        samples[n].first = Clamp(x + _pattern._jitter * NextGaussian(&rng), _w);
+        samples[n].second = Clamp(y + _pattern._jitter * NextGaussian(&rng), _h);
+        n++;
+      }
+      return n;
     }
 
-    return std::move(samples);
+   private:
+    const JitteredMortonAccessPattern &_pattern;
+    const int _w;
+    const int _h;
+    CurveCursor<MortonDecoder> _cursor;
+    uint64_t _next;
+  };
+
+  const uint64_t _seed;
+  const double _jitter;
+};
+
+// Independent samples drawn from a mixture of normal distributions around
+// a few random points and a uniform distribution over the texture.
+class HotSpotAccessPattern : public AccessPattern {
+ public:
+  HotSpotAccessPattern(uint64_t seed, int num_spots, double radius, double weight)
+    : _seed(seed), _num_spots(num_spots), _radius(radius), _weight(weight) { }
+
+  virtual std::vector<std::pair<int, int> >
+  GenerateSamples(int w, int h) const {
+    return GenerateFromStream(w, h);
+  }
+
+  virtual std::unique_ptr<SampleStream> Stream(int w, int h) const {
+    return std::unique_ptr<SampleStream>(new HotSpotStream(*this, w, h));
   }
+
+ private:
+  class HotSpotStream : public SampleStream {
+   public:
+    HotSpotStream(const HotSpotAccessPattern &pattern, int w, int h)
+      : _pattern(pattern), _w(w), _h(h), _spots(pattern._num_spots), _next(0)
+      , _num_samples(static_cast<uint64_t>(w) * h) {
+      Xoshiro256 rng(pattern._seed);
+      for (std::pair<double, double> &spot : _spots) {
+        spot.first = NextUniform(&rng) * w;
+        spot.second = NextUniform(&rng) * h;
+      }
+    }
+
+    virtual size_t Next(std::pair<int, int> *samples, size_t max_samples) {
+      const size_t n = static_cast<size_t>(std::min<uint64_t>(max_samples, _num_samples - _next));
+      for (size_t i = 0; i < n; ++i) {
+        CounterGenerator rng(_pattern._seed, _next++);
+        if (!_spots.empty() && NextUniform(&rng) < _pattern._weight) {
+          const std::pair<double, double> &spot = _spots[rng.Next() % _spots.size()];
+          samples[i].first = Clamp(spot.first + _pattern._radius * NextGaussian(&rng), _w);
+          samples[i].second = Clamp(spot.second + _pattern._radius * NextGaussian(&rng), _h);
+        } else {
+          samples[i].first = static_cast<int>(rng.Next() % _w);
+          samples[i].second = static_cast<int>(rng.Next() % _h);
+        }
+      }
+      return n;
+    }
+
+   private:
+    const HotSpotAccessPattern &_pattern;
+    const int _w;
+    const int _h;
+    std::vector<std::pair<double, double> > _spots;
+    uint64_t _next;
+    const uint64_t _num_samples;
+  };
+
+  const uint64_t _seed;
+  const int _num_spots;
+  const double _radius;
+  const double _weight;
 };
 
-std::unique_ptr<AccessPattern> AccessPattern::Create(EAccessPattern pattern) {
+const char *GetWavefrontScheduleName(EWavefrontSchedule schedule) {
+  switch (schedule) {
+    case eWavefrontSchedule_RoundRobin: return "round-robin";
+    case eWavefrontSchedule_GreedyThenOldest: return "greedy-then-oldest";
+    case kNumWavefrontSchedules: break;
+  }
+  assert(false);
+  return "";
+}
+
+const char *GetStepDistributionName(EStepDistribution distribution) {
+  switch (distribution) {
+    case eStepDistribution_Gaussian: return "gaussian";
+    case eStepDistribution_Cauchy: return "cauchy";
+    case kNumStepDistributions: break;
+  }
+  assert(false);
+  return "";
+}
+
+const char *AccessPattern::GetName(EAccessPattern pattern) {
+  switch(pattern) {
+    case eAccessPattern_Random: return "random";
+    case eAccessPattern_Morton: return "morton";
+    case eAccessPattern_Raster: return "raster";
+    case eAccessPattern_Hilbert: return "hilbert";
+    case eAccessPattern_TiledMorton: return "tiled morton";
+    case eAccessPattern_RandomWalk: return "random walk";
+    case eAccessPattern_JitteredMorton: return "morton jitter";
+    case eAccessPattern_HotSpots: return "hot spots";
+    default: break;
+  }
+  assert(false);
+  return "";
+}
+
+std::unique_ptr<AccessPattern> AccessPattern::Create(EAccessPattern pattern,
+                                                     const PatternOptions &options) {
   switch(pattern) {
     case eAccessPattern_Random:
-      return std::move(std::unique_ptr<AccessPattern>(new RandomAccessPattern));
+      return std::unique_ptr<AccessPattern>(new RandomAccessPattern(options.seed));
     case eAccessPattern_Morton:
       return std::move(std::unique_ptr<AccessPattern>(new MortonAccessPattern));
     case eAccessPattern_Raster:
       return std::move(std::unique_ptr<AccessPattern>(new RasterAccessPattern));
+    case eAccessPattern_Hilbert:
+      return std::unique_ptr<AccessPattern>(new HilbertAccessPattern);
+    case eAccessPattern_TiledMorton:
+      return std::unique_ptr<AccessPattern>(
+        new TiledMortonAccessPattern(kDefaultMortonTileSize));
+    case eAccessPattern_RandomWalk:
+      return std::unique_ptr<AccessPattern>(
+        new RandomWalkAccessPattern(options.seed, options.walk_step, options.walk_distribution));
+    case eAccessPattern_JitteredMorton:
+      return std::unique_ptr<AccessPattern>(
+        new JitteredMortonAccessPattern(options.seed, options.jitter));
+    case eAccessPattern_HotSpots:
+      return std::unique_ptr<AccessPattern>(
+        new HotSpotAccessPattern(options.seed, options.num_hot_spots, options.hot_spot_radius,
+                                 options.hot_spot_weight));
+    default:
+      break;
   }
   assert(false);
   return nullptr;
 }
 
+// Hands out a list of samples that has already been generated.
+class ListStream : public SampleStream {
+ public:
+  explicit ListStream(std::vector<std::pair<int, int> > samples)
+    : _samples(std::move(samples)), _next(0) { }
+
+  virtual size_t Next(std::pair<int, int> *samples, size_t max_samples) {
+    const size_t n = std::min(max_samples, _samples.size() - _next);
+    std::copy(_samples.begin() + _next, _samples.begin() + _next + n, samples);
+    _next += n;
+    return n;
+  }
+
+ private:
+  const std::vector<std::pair<int, int> > _samples;
+  size_t _next;
+};
+
+std::unique_ptr<SampleStream> AccessPattern::Stream(int w, int h) const {
+  return std::unique_ptr<SampleStream>(new ListStream(GenerateSamples(w, h)));
+}
+
+std::vector<std::pair<int, int> > AccessPattern::GenerateFromStream(int w, int h) const {
+  std::vector<std::pair<int, int> > samples(static_cast<size_t>(w) * h);
+  std::unique_ptr<SampleStream> stream = Stream(w, h);
+  size_t num_samples = 0;
+  while (num_samples < samples.size()) {
+    const size_t n = stream->Next(&samples[num_samples], samples.size() - num_samples);
+    if (0 == n) {
+      break;
+    }
+    num_samples += n;
+  }
+  samples.resize(num_samples);
+  return samples;
+}
+
+// Samples per batch, both for generating samples and for caches that
+// can take batched requests.
+static const size_t kBatchSize = 1024;
+
+// Fills samples with the next batch of the stream, timed as generation.
+static size_t NextBatch(SampleStream *stream, std::vector<std::pair<int, int> > *samples) {
+  ScopedPhase phase(eProfilePhase_Generate);
+  return stream->Next(samples->data(), samples->size());
+}
+
 void AccessPattern::Run(const std::unique_ptr<Texture> &tex, Cache *c) const {
-  std::vector<std::pair<int, int> > samples =
-    std::move(this->GenerateSamples(tex->GetWidth(), tex->GetHeight()));
-  assert(samples.size() == static_cast<size_t>(tex->GetWidth() * tex->GetHeight()));
+  std::unique_ptr<SampleStream> stream;
+  {
+    ScopedPhase phase(eProfilePhase_Generate);
+    stream = Stream(tex->GetWidth(), tex->GetHeight());
+  }
+
+  const bool batched = c->CanAccessBatch() && !tex->IsInstrumented();
+  std::vector<std::pair<int, int> > samples(kBatchSize);
+  std::vector<CacheRequest> requests;
+  size_t num_samples = 0;
+  while (const size_t n = NextBatch(stream.get(), &samples)) {
+    num_samples += n;
+
+    ScopedPhase phase(eProfilePhase_Simulate);
+    if (batched) {
+      requests.clear();
+      tex->AccessBatch(samples.data(), n, &requests);
+      c->AccessBatch(requests.data(), requests.size());
+      continue;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+      tex->Sample(samples[i].first, samples[i].second, c);
+      c->EndSample();
+    }
+  }
+  assert(num_samples == static_cast<size_t>(tex->GetWidth()) * tex->GetHeight());
+}
+
+void AccessPattern::Sample(const Scene &scene, const std::pair<int, int> &pixel, Cache *c) {
+  for (size_t i = 0; i < scene.GetNumTextures(); ++i) {
+    const std::unique_ptr<Texture> &tex = scene.GetTexture(i);
+    c->SetOwner(static_cast<int>(i));
+
+    // Scale the pixel into this texture's coordinates...
+    int x = static_cast<int>(static_cast<int64_t>(pixel.first) * tex->GetWidth() / scene.GetWidth());
+    int y = static_cast<int>(static_cast<int64_t>(pixel.second) * tex->GetHeight() / scene.GetHeight());
+    tex->Sample(x, y, c);
+  }
+  c->EndSample();
+}
+
+void AccessPattern::Run(const Scene &scene, Cache *c, const WavefrontOptions &wavefronts) const {
+  const int w = scene.GetWidth();
+  const int h = scene.GetHeight();
 
-  for (auto sample : samples) {
-    tex->Access(sample.first, sample.second, c);
+  // Wavefronts claim pieces of the whole pattern, so they take it all at
+  // once...
+  if (wavefronts.num_wavefronts > 1) {
+    std::vector<std::pair<int, int> > samples;
+    {
+      ScopedPhase phase(eProfilePhase_Generate);
+      samples = this->GenerateSamples(w, h);
+    }
+    assert(samples.size() == static_cast<size_t>(w) * h);
+
+    ScopedPhase phase(eProfilePhase_Simulate);
+    RunWavefronts(scene, samples, c, wavefronts);
+    return;
+  }
+
+  std::unique_ptr<SampleStream> stream;
+  {
+    ScopedPhase phase(eProfilePhase_Generate);
+    stream = Stream(w, h);
+  }
+
+  if (c->CanAccessBatch() && !scene.HasInstrumentedTextures()) {
+    RunBatched(scene, stream.get(), c);
+    return;
+  }
+
+  std::vector<std::pair<int, int> > samples(kBatchSize);
+  while (const size_t n = NextBatch(stream.get(), &samples)) {
+    ScopedPhase phase(eProfilePhase_Simulate);
+    for (size_t i = 0; i < n; ++i) {
+      Sample(scene, samples[i], c);
+    }
+  }
+}
+
+void AccessPattern::RunWavefronts(const Scene &scene,
+                                  const std::vector<std::pair<int, int> > &samples,
+                                  Cache *c, const WavefrontOptions &wavefronts) const {
+  assert(wavefronts.samples_per_wavefront > 0 && wavefronts.interleave > 0);
+
+  // The samples left to a wavefront and when it picked them up...
+  struct Wavefront {
+    size_t next;
+    size_t end;
+    size_t age;
+  };
+
+  size_t next_piece = 0;
+  size_t num_pieces = 0;
+  std::vector<Wavefront> active;
+  auto claim = [&](Wavefront *wf) {
+    wf->next = next_piece;
+    wf->end = std::min(samples.size(), next_piece + wavefronts.samples_per_wavefront);
+    wf->age = num_pieces++;
+    next_piece = wf->end;
+  };
+
+  while (active.size() < wavefronts.num_wavefronts && next_piece < samples.size()) {
+    Wavefront wf;
+    claim(&wf);
+    active.push_back(wf);
+  }
+
+  size_t current = 0;
+  while (!active.empty()) {
+    Wavefront &wf = active[current];
+    const size_t sectors_filled = c->GetNumSectorsFilled();
+    const size_t end = std::min(wf.end, wf.next + wavefronts.interleave);
+    for (; wf.next < end; ++wf.next) {
+      Sample(scene, samples[wf.next], c);
+    }
+    const bool stalled = c->GetNumSectorsFilled() != sectors_filled;
+
+    // A wavefront that is done picks up the next piece, or retires...
+    const bool done = wf.next == wf.end;
+    bool retired = false;
+    if (done && next_piece < samples.size()) {
+      claim(&wf);
+    } else if (done) {
+      active.erase(active.begin() + current);
+      retired = true;
+      if (active.empty()) {
+        break;
+      }
+    }
+
+    if (eWavefrontSchedule_RoundRobin == wavefronts.schedule) {
+      current = (retired ? current : current + 1) % active.size();
+    } else if (done || stalled) {
+      // The oldest wavefront, other than one that just stalled...
+      const size_t skip = (!done && active.size() > 1) ? current : active.size();
+      size_t oldest = active.size();
+      for (size_t i = 0; i < active.size(); ++i) {
+        if (i != skip && (oldest == active.size() || active[i].age < active[oldest].age)) {
+          oldest = i;
+        }
+      }
+      current = oldest;
+    }
+  }
+}
+
+void AccessPattern::RunBatched(const Scene &scene, SampleStream *stream, Cache *c) const {
+  const int w = scene.GetWidth();
+  const int h = scene.GetHeight();
+  const size_t num_textures = scene.GetNumTextures();
+
+  // Pixel to texel coordinates of each texture, scaled as in Run...
+  std::vector<std::vector<int> > scale_x(num_textures, std::vector<int>(w));
+  std::vector<std::vector<int> > scale_y(num_textures, std::vector<int>(h));
+  for (size_t t = 0; t < num_textures; ++t) {
+    const std::unique_ptr<Texture> &tex = scene.GetTexture(t);
+    for (int x = 0; x < w; ++x) {
+      scale_x[t][x] = static_cast<int>(static_cast<int64_t>(x) * tex->GetWidth() / w);
+    }
+    for (int y = 0; y < h; ++y) {
+      scale_y[t][y] = static_cast<int>(static_cast<int64_t>(y) * tex->GetHeight() / h);
+    }
+  }
+
+  // Each texture builds its requests for a whole batch of pixels, which
+  // are then sent in the order Run would send them.
+  std::vector<std::pair<int, int> > samples(kBatchSize);
+  std::vector<std::pair<int, int> > texels(kBatchSize);
+  std::vector<std::vector<CacheRequest> > requests(num_textures);
+  std::vector<size_t> next(num_textures);
+  while (const size_t n = NextBatch(stream, &samples)) {
+    ScopedPhase phase(eProfilePhase_Simulate);
+    for (size_t t = 0; t < num_textures; ++t) {
+      for (size_t i = 0; i < n; ++i) {
+        const std::pair<int, int> &sample = samples[i];
+        texels[i].first = scale_x[t][sample.first];
+        texels[i].second = scale_y[t][sample.second];
+      }
+      requests[t].clear();
+      scene.GetTexture(t)->AccessBatch(texels.data(), n, &requests[t]);
+    }
+
+    if (1 == num_textures) {
+      c->AccessBatch(requests[0].data(), requests[0].size());
+      continue;
+    }
+
+    // Interleave the textures' requests pixel by pixel...
+    std::fill(next.begin(), next.end(), 0);
+    for (size_t i = 0; i < n; ++i) {
+      for (size_t t = 0; t < num_textures; ++t) {
+        const CacheRequest *r = &requests[t][next[t]];
+        size_t count = 1;
+        while (!r[count - 1].end_of_sample) {
+          count++;
+        }
+        next[t] += count;
+
+        c->SetOwner(static_cast<int>(t));
+        for (size_t k = 0; k < count; ++k) {
+          c->Access(r[k].address, r[k].num_bytes);
+        }
+      }
+      c->EndSample();
+    }
   }
 }
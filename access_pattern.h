@@ -1,29 +1,160 @@
 #ifndef __ACCESS_PATTERN_H__
 #define __ACCESS_PATTERN_H__
 
+#include <cstdint>
+#include <cstddef>
 #include <memory>
+#include <utility>
 #include <vector>
 
 enum EAccessPattern {
   eAccessPattern_Random,
   eAccessPattern_Morton,
   eAccessPattern_Raster,
+  eAccessPattern_Hilbert,
+  eAccessPattern_TiledMorton,
+
+  // Stochastic patterns between the ordered and the uniformly random
+  // ones, each with its locality set by PatternOptions.
+  eAccessPattern_RandomWalk,
+  eAccessPattern_JitteredMorton,
+  eAccessPattern_HotSpots,
+
+  kNumAccessPatterns
+};
+
+// Distribution of the steps of the random walk pattern.
+enum EStepDistribution {
+  eStepDistribution_Gaussian,
+
+  // Heavy tailed: mostly short steps with occasional long jumps.
+  eStepDistribution_Cauchy,
+
+  kNumStepDistributions
+};
+
+const char *GetStepDistributionName(EStepDistribution distribution);
+
+// Side of the square tiles walked by the tiled Morton pattern.
+static const int kDefaultMortonTileSize = 16;
+
+// Seed of the random pattern unless one is given.
+static const uint64_t kDefaultRandomSeed = 1;
+
+// Parameters of the random and stochastic patterns. Distances are in
+// pixels; smaller ones mean more locality.
+struct PatternOptions {
+  PatternOptions()
+    : seed(kDefaultRandomSeed), walk_step(2.0), walk_distribution(eStepDistribution_Gaussian)
+    , jitter(4.0), num_hot_spots(8), hot_spot_radius(16.0), hot_spot_weight(0.9) { }
+
+  uint64_t seed;
+
+  // Scale of each step of the random walk.
+  double walk_step;
+  EStepDistribution walk_distribution;
+
+  // Standard deviation of the offset added to each sample of a Morton
+  // walk.
+  double jitter;
+
+  // Samples fall around one of num_hot_spots random points with
+  // probability hot_spot_weight, and anywhere otherwise. Around a hot
+  // spot they are normally distributed with hot_spot_radius as the
+  // standard deviation.
+  int num_hot_spots;
+  double hot_spot_radius;
+  double hot_spot_weight;
+};
+
+// How the wavefronts of the concurrent mode take turns at the cache.
+enum EWavefrontSchedule {
+  // Each wavefront in turn.
+  eWavefrontSchedule_RoundRobin,
+
+  // The same wavefront until one of its turns misses, then the oldest
+  // other one, like the greedy-then-oldest warp schedulers of GPUs.
+  eWavefrontSchedule_GreedyThenOldest,
+
+  kNumWavefrontSchedules
+};
+
+const char *GetWavefrontScheduleName(EWavefrontSchedule schedule);
+
+// Concurrent mode: the pattern's samples are cut into consecutive pieces
+// of samples_per_wavefront, e.g. the screen tiles of a tiled walk, and
+// num_wavefronts of them are in flight at a time. Each turn of a
+// wavefront issues its next interleave samples. A wavefront that is done
+// picks up the next unclaimed piece. One wavefront is the plain
+// sequential run.
+struct WavefrontOptions {
+  WavefrontOptions()
+    : num_wavefronts(1), samples_per_wavefront(64), interleave(1)
+    , schedule(eWavefrontSchedule_RoundRobin) { }
+
+  size_t num_wavefronts;
+  size_t samples_per_wavefront;
+  size_t interleave;
+  EWavefrontSchedule schedule;
 };
 
 // Forward declare
 class Texture;
 class Cache;
+class Scene;
+
+// The samples of an access pattern, produced a batch at a time.
+class SampleStream {
+ public:
+  virtual ~SampleStream() { }
+
+  // Writes up to max_samples of the next samples to samples and returns
+  // how many it wrote, zero once the pattern is done.
+  virtual size_t Next(std::pair<int, int> *samples, size_t max_samples) = 0;
+};
 
 class AccessPattern {
  public:
-  static std::unique_ptr<AccessPattern> Create(EAccessPattern pattern);
+  static std::unique_ptr<AccessPattern> Create(EAccessPattern pattern,
+                                               const PatternOptions &options = PatternOptions());
+  static const char *GetName(EAccessPattern pattern);
+  virtual ~AccessPattern() { }
+
   void Run(const std::unique_ptr<Texture> &tex, Cache *c) const;
 
- protected:
-  AccessPattern() { }
+  // Samples every texture of the scene at each pixel before moving on to
+  // the next one, in the order they were added to the scene.
+  void Run(const Scene &scene, Cache *c,
+           const WavefrontOptions &wavefronts = WavefrontOptions()) const;
+
+  // Samples every texture of the scene at one pixel, scaled into each
+  // texture's coordinates.
+  static void Sample(const Scene &scene, const std::pair<int, int> &pixel, Cache *c);
 
+  // The w * h samples taken from a w x h texture, in order. All but the
+  // stochastic patterns visit every texel exactly once.
   virtual std::vector<std::pair<int, int> >
     GenerateSamples(int w, int h) const = 0;
+
+  // The samples of GenerateSamples(w, h) in the same order. The random
+  // and stochastic patterns make each batch as it is asked for, so they
+  // never hold all w * h samples; the others hand out a generated list.
+  // The stream refers to the pattern, which must outlive it.
+  virtual std::unique_ptr<SampleStream> Stream(int w, int h) const;
+
+ protected:
+  AccessPattern() { }
+
+  // GenerateSamples for patterns that implement Stream.
+  std::vector<std::pair<int, int> > GenerateFromStream(int w, int h) const;
+
+ private:
+  // Run(scene, c) for caches that take whole batches of requests.
+  void RunBatched(const Scene &scene, SampleStream *samples, Cache *c) const;
+
+  // Run(scene, c) with more than one wavefront.
+  void RunWavefronts(const Scene &scene, const std::vector<std::pair<int, int> > &samples,
+                     Cache *c, const WavefrontOptions &wavefronts) const;
 };
 
 #endif // __ACCESS_PATTERN_H__
@@ -0,0 +1,310 @@
+#include <iostream>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "access_pattern.h"
+#include "cache.h"
+#include "texture.h"
+
+// Microbenchmarks for the simulator's hot paths. Every benchmark runs once
+// to warm up and then a fixed number of timed repetitions; we report the
+// per-item time of the median repetition along with min/mean/stddev so
+// that noisy runs are easy to spot.
+
+static void PrintUsageAndExit(const char *prog) {
+  std::cerr << "Usage: " << prog << " [--reps N] [--size N] [--filter substr] [--json file]" << std::endl;
+  exit(1);
+}
+
+struct BenchResult {
+  std::string name;
+  size_t items_per_rep;
+  std::vector<double> seconds;
+
+  double Min() const { return *std::min_element(seconds.begin(), seconds.end()); }
+
+  double Median() const {
+    std::vector<double> sorted = seconds;
+    std::sort(sorted.begin(), sorted.end());
+    const size_t n = sorted.size();
+    return (n % 2) ? sorted[n / 2] : 0.5 * (sorted[n / 2 - 1] + sorted[n / 2]);
+  }
+
+  double Mean() const {
+    double sum = 0.0;
+    for (double s : seconds) { sum += s; }
+    return sum / seconds.size();
+  }
+
+  double StdDev() const {
+    const double mean = Mean();
+    double sum = 0.0;
+    for (double s : seconds) { sum += (s - mean) * (s - mean); }
+    return seconds.size() > 1 ? std::sqrt(sum / (seconds.size() - 1)) : 0.0;
+  }
+};
+
+class BenchRunner {
+ public:
+  BenchRunner(int reps, const std::string &filter) : _reps(reps), _filter(filter) { }
+
+  bool Enabled(const std::string &name) const {
+    return _filter.empty() || name.find(_filter) != std::string::npos;
+  }
+
+  // Times fn, which processes items things per call.
+  template<typename Fn>
+  void Run(const std::string &name, size_t items, Fn fn) {
+    if (!Enabled(name)) {
+      return;
+    }
+
+    BenchResult result;
+    result.name = name;
+    result.items_per_rep = items;
+
+    fn();
+    for (int i = 0; i < _reps; ++i) {
+      auto start = std::chrono::steady_clock::now();
+      fn();
+      auto end = std::chrono::steady_clock::now();
+      result.seconds.push_back(std::chrono::duration<double>(end - start).count());
+    }
+
+    PrintResult(result);
+    _results.push_back(result);
+  }
+
+  void WriteJSON(std::ostream &os, int texture_size) const {
+    os << "{" << std::endl;
+    os << "  \"context\": { \"repetitions\": " << _reps
+       << ", \"texture_size\": " << texture_size << " }," << std::endl;
+    os << "  \"benchmarks\": [" << std::endl;
+    for (size_t i = 0; i < _results.size(); ++i) {
+      const BenchResult &r = _results[i];
+      os << "    { \"name\": \"" << r.name << "\""
+         << ", \"items_per_rep\": " << r.items_per_rep
+         << ", \"min_s\": " << r.Min()
+         << ", \"median_s\": " << r.Median()
+         << ", \"mean_s\": " << r.Mean()
+         << ", \"stddev_s\": " << r.StdDev()
+         << ", \"items_per_second\": " << r.items_per_rep / r.Median()
+         << " }" << (i + 1 < _results.size() ? "," : "") << std::endl;
+    }
+    os << "  ]" << std::endl;
+    os << "}" << std::endl;
+  }
+
+  static void PrintHeader() {
+    printf("%-40s %12s %12s %12s %8s\n", "benchmark", "ns/item", "Mitems/s", "min ns/item", "stddev");
+  }
+
+ private:
+  static void PrintResult(const BenchResult &r) {
+    const double ns_per_item = 1e9 * r.Median() / r.items_per_rep;
+    printf("%-40s %12.2f %12.2f %12.2f %7.1f%%\n", r.name.c_str(), ns_per_item,
+           r.items_per_rep / r.Median() / 1e6, 1e9 * r.Min() / r.items_per_rep,
+           100.0 * r.StdDev() / r.Mean());
+    fflush(stdout);
+  }
+
+  const int _reps;
+  const std::string _filter;
+  std::vector<BenchResult> _results;
+};
+
+// A visualization image with a random mix of the block types recognized
+// by the adaptive textures, laid out on the 12x12 grid.
+static std::vector<unsigned char> MakeVisImage(int w, int h, std::mt19937 *rng) {
+  const uint32_t kRed = 0xFF0000FF;
+  const uint32_t kGreen = 0xFF00FF00;
+  const uint32_t kBlue = 0xFFFF0000;
+  const uint32_t kYellow = 0xFF00FFFF;
+
+  std::vector<uint32_t> pixels(static_cast<size_t>(w) * h, kGreen);
+  for (int by = 0; by + 12 <= h; by += 12) {
+    for (int bx = 0; bx + 12 <= w; bx += 12) {
+      const int kind = (*rng)() % 4;
+      const int ox = ((*rng)() % 2) * 4;
+      const int oy = ((*rng)() % 2) * 4;
+      for (int j = 0; j < 12; ++j) {
+        for (int i = 0; i < 12; ++i) {
+          uint32_t color = kGreen;
+          if (kind == 1) {
+            color = kRed;
+          } else if (kind == 2) {
+            color = kBlue;
+          } else if (kind == 3 && i >= ox && i <= ox + 8 && j >= oy && j <= oy + 8) {
+            color = kYellow;
+          }
+          pixels[(by + j) * w + bx + i] = color;
+        }
+      }
+    }
+  }
+
+  std::vector<unsigned char> result(pixels.size() * 4);
+  memcpy(result.data(), pixels.data(), result.size());
+  return result;
+}
+
+static std::unordered_map<int, int> MakeDuplicates(int num_blocks) {
+  std::unordered_map<int, int> duplicates;
+  for (int i = 0; i < num_blocks; ++i) {
+    duplicates[i] = i;
+  }
+  return duplicates;
+}
+
+int main(int argc, char **argv) {
+  int reps = 10;
+  int size = 1024;
+  std::string filter;
+  const char *json_filename = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (i + 1 >= argc) {
+      PrintUsageAndExit(argv[0]);
+    } else if (arg == "--reps") {
+      reps = atoi(argv[++i]);
+    } else if (arg == "--size") {
+      size = atoi(argv[++i]);
+    } else if (arg == "--filter") {
+      filter = argv[++i];
+    } else if (arg == "--json") {
+      json_filename = argv[++i];
+    } else {
+      PrintUsageAndExit(argv[0]);
+    }
+  }
+
+  if (reps <= 0 || size < 12) {
+    PrintUsageAndExit(argv[0]);
+  }
+  size = (size / 12) * 12;
+
+  BenchRunner runner(reps, filter);
+  BenchRunner::PrintHeader();
+
+  // Cache::Access over synthetic address streams for each geometry...
+  std::mt19937 rng(12345);
+  const size_t kNumAddresses = 1 << 18;
+  std::vector<size_t> sequential(kNumAddresses);
+  std::vector<size_t> random(kNumAddresses);
+  for (size_t i = 0; i < kNumAddresses; ++i) {
+    sequential[i] = i * 16;
+    random[i] = (rng() % (1 << 20)) & ~static_cast<size_t>(15);
+  }
+
+  // size KB, line size, sector size, ways (0 for fully associative)
+  const size_t kCacheGeometries[][4] = {
+    { 1, 64, 64, 0 },
+    { 4, 64, 64, 0 },
+    { 16, 64, 64, 0 },
+    { 4, 32, 32, 0 },
+    { 4, 128, 128, 0 },
+    { 4, 128, 32, 0 },
+    { 16, 64, 64, 16 },
+    { 64, 64, 64, 64 },
+  };
+  for (const auto &geometry_desc : kCacheGeometries) {
+    CacheConfig config(geometry_desc[0]);
+    config.line_size = geometry_desc[1];
+    config.sector_size = geometry_desc[2];
+    config.num_ways = geometry_desc[3];
+    Cache c(config);
+
+    std::string geometry = std::to_string(config.size_in_kb) + "KB/" +
+      std::to_string(config.line_size) + "B";
+    if (config.sector_size < config.line_size) {
+      geometry += "/" + std::to_string(config.sector_size) + "B";
+    }
+    if (config.num_ways > 0) {
+      geometry += "/" + std::to_string(config.num_ways) + "way";
+    }
+    runner.Run("Cache::Access/" + geometry + "/sequential", kNumAddresses, [&] {
+      for (size_t addr : sequential) { c.Access(addr, 16); }
+    });
+    runner.Run("Cache::Access/" + geometry + "/random", kNumAddresses, [&] {
+      for (size_t addr : random) { c.Access(addr, 16); }
+    });
+  }
+
+  // Sample generation for each pattern...
+  for (int i = 0; i < kNumAccessPatterns; ++i) {
+    EAccessPattern pattern = static_cast<EAccessPattern>(i);
+    std::unique_ptr<AccessPattern> ap = AccessPattern::Create(pattern);
+    runner.Run(std::string("GenerateSamples/") + AccessPattern::GetName(pattern),
+               static_cast<size_t>(size) * size, [&] {
+      std::vector<std::pair<int, int> > samples = ap->GenerateSamples(size, size);
+      if (samples.empty()) { abort(); }
+    });
+  }
+
+  // Layout construction of the adaptive textures...
+  std::vector<unsigned char> vis = MakeVisImage(size, size, &rng);
+  const std::unordered_map<int, int> dup4x4 = MakeDuplicates((size / 4) * (size / 4));
+  const std::unordered_map<int, int> dup12x12 = MakeDuplicates((size / 12) * (size / 12));
+
+  runner.Run("Layout/Adaptive4x4", (size / 4) * (size / 4), [&] {
+    Texture::Create(eTextureType_Adaptive4x4, size, size, dup4x4, 4, vis.data());
+  });
+  runner.Run("Layout/Adaptive12x12", (size / 12) * (size / 12), [&] {
+    Texture::Create(eTextureType_Adaptive12x12, size, size, dup12x12, 4, vis.data());
+  });
+
+  // Texture::Access for each texture type over a raster walk...
+  struct NamedTexture {
+    const char *name;
+    std::unique_ptr<Texture> tex;
+  };
+  NamedTexture textures[] = {
+    { "ASTC4x4", Texture::Create(eTextureType_ASTC4x4, size, size) },
+    { "ASTC6x6", Texture::Create(eTextureType_ASTC6x6, size, size) },
+    { "ASTC8x8", Texture::Create(eTextureType_ASTC8x8, size, size) },
+    { "ASTC12x12", Texture::Create(eTextureType_ASTC12x12, size, size) },
+    { "Adaptive4x4", Texture::Create(eTextureType_Adaptive4x4, size, size, dup4x4, 4, vis.data()) },
+    { "Adaptive12x12", Texture::Create(eTextureType_Adaptive12x12, size, size, dup12x12, 4, vis.data()) },
+  };
+
+  std::vector<std::pair<int, int> > samples =
+    AccessPattern::Create(eAccessPattern_Raster)->GenerateSamples(size, size);
+  for (const NamedTexture &t : textures) {
+    Cache c(1);
+    runner.Run(std::string("Texture::Access/") + t.name, samples.size(), [&] {
+      for (const auto &sample : samples) { t.tex->Access(sample.first, sample.second, &c); }
+    });
+
+    // ... and in batches, the way AccessPattern::Run drives it.
+    const size_t kBatchSize = 1024;
+    std::vector<CacheRequest> requests;
+    runner.Run(std::string("Texture::AccessBatch/") + t.name, samples.size(), [&] {
+      for (size_t i = 0; i < samples.size(); i += kBatchSize) {
+        requests.clear();
+        t.tex->AccessBatch(&samples[i], std::min(kBatchSize, samples.size() - i), &requests);
+        c.AccessBatch(requests.data(), requests.size());
+      }
+    });
+  }
+
+  if (nullptr != json_filename) {
+    std::ofstream json(json_filename);
+    if (!json) {
+      std::cerr << "Error opening " << json_filename << std::endl;
+      return 1;
+    }
+    runner.WriteJSON(json, size);
+  }
+
+  return 0;
+}
@@ -0,0 +1,37 @@
+#include "block_type_stats.h"
+
+#include <cassert>
+
+#include "cache.h"
+
+BlockTypeStats::Mark::Mark(const Cache &c)
+  : num_lines(c.GetNumAccesses())
+  , num_hits(c.GetNumHits())
+  , num_misses(c.GetNumMisses())
+  , num_victim_hits(c.GetNumVictimHits())
+  , num_sectors_filled(c.GetNumSectorsFilled()) { }
+
+BlockTypeStats::BlockTypeStats(const std::vector<std::string> &type_names)
+  : _type_names(type_names) {
+  assert(!type_names.empty());
+  Clear();
+}
+
+void BlockTypeStats::Record(int type, EPart part, const Cache &c, Mark *mark) {
+  assert(type >= 0 && static_cast<size_t>(type) < _type_names.size());
+  const Mark now(c);
+  Counts &counts = _counts[type * kNumParts + part];
+  counts.num_samples++;
+  counts.num_lines += now.num_lines - mark->num_lines;
+  counts.num_hits += now.num_hits - mark->num_hits;
+  counts.num_misses += now.num_misses - mark->num_misses;
+  counts.num_victim_hits += now.num_victim_hits - mark->num_victim_hits;
+  counts.bytes_filled +=
+    (now.num_sectors_filled - mark->num_sectors_filled) * c.GetConfig().sector_size;
+  *mark = now;
+}
+
+void BlockTypeStats::Clear() {
+  const Counts kZero = { 0, 0, 0, 0, 0, 0 };
+  _counts.assign(_type_names.size() * kNumParts, kZero);
+}
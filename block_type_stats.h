@@ -0,0 +1,66 @@
+#ifndef __BLOCK_TYPE_STATS_H__
+#define __BLOCK_TYPE_STATS_H__
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Forward declare
+class Cache;
+
+// Cache behaviour of an adaptive texture's accesses split by the type of
+// the block sampled and by whether the requests read the metadata or the
+// block payload. Samples served by a decoded block cache never reach
+// memory and aren't counted, and neither are requests served by the
+// block buffer.
+class BlockTypeStats {
+ public:
+  enum EPart {
+    ePart_Metadata,
+    ePart_Payload,
+
+    kNumParts
+  };
+
+  // Samples are counted once per part. The other counts are of cache
+  // lines, as in CacheStats: a request can touch several lines, and the
+  // lines that are neither hits, misses nor victim hits are sector misses.
+  struct Counts {
+    size_t num_samples;
+    size_t num_lines;
+    size_t num_hits;
+    size_t num_misses;
+    size_t num_victim_hits;
+    size_t bytes_filled;
+  };
+
+  // Where the counters of a cache stood before a run of requests.
+  struct Mark {
+    Mark() : num_lines(0), num_hits(0), num_misses(0), num_victim_hits(0), num_sectors_filled(0) { }
+    explicit Mark(const Cache &c);
+
+    size_t num_lines;
+    size_t num_hits;
+    size_t num_misses;
+    size_t num_victim_hits;
+    size_t num_sectors_filled;
+  };
+
+  explicit BlockTypeStats(const std::vector<std::string> &type_names);
+
+  // Attributes what c did since mark to the given block type and part,
+  // and moves mark up to now.
+  void Record(int type, EPart part, const Cache &c, Mark *mark);
+
+  void Clear();
+
+  size_t GetNumTypes() const { return _type_names.size(); }
+  const std::string &GetTypeName(int type) const { return _type_names[type]; }
+  const Counts &GetCounts(int type, EPart part) const { return _counts[type * kNumParts + part]; }
+
+ private:
+  std::vector<std::string> _type_names;
+  std::vector<Counts> _counts;
+};
+
+#endif  // __BLOCK_TYPE_STATS_H__
@@ -1,121 +1,982 @@
 #ifndef __CACHE_H__
 #define __CACHE_H__
 
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <iostream>
 
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include "decoded_cache.h"
+
+// Every line access is exactly one of a hit, a sector miss, a victim hit
+// or a miss, so the four add up to num_accesses.
 struct CacheStats {
+  // Accesses whose line and requested sectors were all in the cache, and
+  // accesses whose line was in neither the cache nor the victim cache.
   size_t num_hits;
   size_t num_misses;
   size_t num_accesses;
+
+  // Accesses whose line was resident but was missing at least one of the
+  // requested sectors.
+  size_t num_sector_misses;
+  size_t num_sectors_filled;
+
+  // Line misses served by the victim cache instead of memory, and
+  // requests served by the block buffer without reaching the cache. A
+  // victim hit is counted once even if it has sectors to refill; those
+  // only show in num_sectors_filled.
+  size_t num_victim_hits;
+  size_t num_block_buffer_hits;
+
+  // Texture samples served by the decoded block cache, and the ASTC block
+  // decodes done to fill it.
+  size_t num_decoded_hits;
+  size_t num_decodes;
+
+  // Banked mode: samples issued, cycles they were grouped into and the
+  // extra cycles spent serializing bank conflicts.
+  size_t num_samples;
+  size_t num_cycles;
+  size_t num_bank_stalls;
+
+  // DRAM traffic. Requested bytes are what the texture asked for; filled
+  // bytes are what the cache fetched from memory. Wasted bytes were
+  // fetched but never touched before the line was evicted; lines still
+  // resident count as if the cache were flushed at the end of the run.
+  size_t bytes_requested;
+  size_t bytes_filled;
+  size_t bytes_wasted;
+
+  // Share of the line accesses that didn't go to memory for their line:
+  // hits and victim hits.
+  double GetHitRate() const {
+    return num_accesses ? static_cast<double>(num_hits + num_victim_hits) / num_accesses : 0.0;
+  }
+};
+
+// Fill and use of the lines brought in on behalf of one owner, e.g. one
+// texture of a scene.
+struct OwnerStats {
+  OwnerStats() : bytes_filled(0), bytes_used(0) { }
+
+  size_t bytes_filled;
+  size_t bytes_used;
+
+  // How many bytes were fetched for every byte that was actually used.
+  double GetOverfetchRatio() const {
+    return bytes_used ? static_cast<double>(bytes_filled) / bytes_used : 0.0;
+  }
+};
+
+enum EBankHash {
+  // Bank is the line index modulo the number of banks.
+  eBankHash_Modulo,
+
+  // Higher bits of the line index are xor-folded into the bank bits, so
+  // power-of-two strides spread over the banks.
+  eBankHash_Xor,
+};
+
+struct CacheConfig {
+  CacheConfig()
+    : size_in_kb(1), line_size(64), sector_size(64)
+    , victim_entries(0), block_buffer_entries(0), decoded_cache_texels(0)
+    , num_banks(0), bank_hash(eBankHash_Modulo), samples_per_cycle(4), num_ways(0) { }
+  explicit CacheConfig(size_t kb)
+    : size_in_kb(kb), line_size(64), sector_size(64)
+    , victim_entries(0), block_buffer_entries(0), decoded_cache_texels(0)
+    , num_banks(0), bank_hash(eBankHash_Modulo), samples_per_cycle(4), num_ways(0) { }
+
+  // Line and sector sizes must be powers of two with at most
+  // kMaxSectorsPerLine sectors per line, and xor-hashed banks must be a
+  // power of two.
+  static const size_t kMaxSectorsPerLine = 32;
+  bool IsValid() const {
+    return line_size > 0 && sector_size > 0 &&
+      (line_size & (line_size - 1)) == 0 && (sector_size & (sector_size - 1)) == 0 &&
+      sector_size <= line_size && line_size / sector_size <= kMaxSectorsPerLine &&
+      size_in_kb * 1024 >= line_size &&
+      (num_ways == 0 || ((size_in_kb * 1024) / line_size) % num_ways == 0) &&
+      (bank_hash != eBankHash_Xor || (num_banks & (num_banks - 1)) == 0);
+  }
+
+  size_t size_in_kb;
+  size_t line_size;
+
+  // Unit of fill and validity within a line. Equal to the line size for
+  // an unsectored cache.
+  size_t sector_size;
+
+  // Lines in a fully-associative victim cache behind the cache. Lines
+  // evicted from the cache go there, and a line miss that finds its line
+  // in the victim cache swaps it back instead of going to memory. Zero
+  // disables it.
+  size_t victim_entries;
+
+  // Entries in a fully-associative LRU buffer in front of the cache that
+  // holds the most recently requested compressed blocks (by address), like
+  // the small buffer of decoded blocks in a texture unit. Only block
+  // payloads requested through AccessBlock go through it; metadata reads
+  // don't take entries. A block found there never reaches the cache. Zero
+  // disables it.
+  size_t block_buffer_entries;
+
+  // Capacity in texels of a cache of decompressed blocks consulted by
+  // Texture::Sample before any memory access. Zero disables it.
+  size_t decoded_cache_texels;
+
+  // Banked mode. The lines touched by each group of samples_per_cycle
+  // consecutive samples (a quad or a warp) are serviced in one cycle,
+  // except that distinct lines mapping to the same bank take one cycle
+  // each. Zero banks disables it.
+  size_t num_banks;
+  EBankHash bank_hash;
+  size_t samples_per_cycle;
+
+  // Lines per set; sets are indexed by line address modulo the number of
+  // sets. Zero makes the cache fully associative.
+  size_t num_ways;
+};
+
+// A memory request produced by Texture::AccessBatch. end_of_sample marks
+// the last request of each sample.
+struct CacheRequest {
+  size_t address;
+  uint32_t num_bytes;
+  uint16_t owner;
+  uint16_t end_of_sample;
 };
 
-// LRU cache with 64 byte cache lines.
+// One event of a recorded request stream. Streams are recorded once and
+// replayed into any number of caches, so they carry everything a cache
+// reacts to: memory requests, owner changes, sample boundaries and the
+// decoded block each sample needs.
+struct MemoryRequest {
+  enum EKind {
+    eKind_Access,       // address, num_bytes
+    eKind_AccessBlock,  // address, num_bytes
+    eKind_SetOwner,   // address holds the owner
+    eKind_Sample,     // address is the texture base, block the decoded block
+    eKind_EndSample,
+  };
+
+  size_t address;
+  DecodedBlock block;
+  uint32_t num_bytes;
+  EKind kind;
+};
+
+// Receives the requests sent to a recording cache.
+class RequestSink {
+ public:
+  virtual ~RequestSink() { }
+  virtual void Push(const MemoryRequest &request) = 0;
+};
+
+// LRU cache with configurable line size and optional sectoring. On a line
+// miss only the requested sectors are filled; later accesses to the other
+// sectors of a resident line are sector misses. Optionally fronted by a
+// block buffer and backed by a victim cache.
 class Cache {
  public:
-  Cache(size_t size_in_kb)
-    : _size_in_kb(size_in_kb)
-    , _lines([&size_in_kb] {
-        int num_lines = (size_in_kb * 1024) / 64;
-        CacheEntry entry;
-        entry._time = 0;
-        entry._addr = 0;
-        entry._valid = false;
-        std::vector<CacheEntry> result =
-          std::vector<CacheEntry>(num_lines, entry);
-        return std::move(result);
-      }())
+  Cache(size_t size_in_kb) : Cache(CacheConfig(size_in_kb)) { }
+
+  Cache(const CacheConfig &config)
+    : _config(config)
+    , _line_shift(Log2(config.line_size))
+    , _sector_shift(Log2(config.sector_size))
+    , _words_per_line((config.line_size + 63) / 64)
+    , _num_lines((config.size_in_kb * 1024) / config.line_size)
+    , _num_ways(config.num_ways > 0 ? config.num_ways : _num_lines)
+    , _num_sets(_num_lines / _num_ways)
+    , _tags(_num_lines + config.victim_entries, static_cast<uint64_t>(kInvalidTag))
+    , _times(_tags.size(), 0)
+    , _sectors(_tags.size(), 0)
+    , _owners(_tags.size(), 0)
+    , _used_bytes(_tags.size() * _words_per_line, 0)
+    , _block_buffer(config.block_buffer_entries, BlockBufferEntry())
+    , _decoded_cache(config.decoded_cache_texels > 0 ?
+                     new DecodedBlockCache(config.decoded_cache_texels) : nullptr)
+    , _sink(nullptr)
+    , _fill_log(nullptr)
+    , _bank_counts(config.num_banks, 0)
+    , _cycle_samples(0)
     , _num_hits(0)
     , _num_misses(0)
     , _num_accesses(0)
+    , _num_sector_misses(0)
+    , _num_sectors_filled(0)
+    , _num_victim_hits(0)
+    , _num_block_buffer_hits(0)
+    , _num_samples(0)
+    , _num_cycles(0)
+    , _num_bank_stalls(0)
+    , _bytes_requested(0)
+    , _bytes_wasted(0)
+    , _owner(0)
+    , _owner_stats(1)
+    , _replay_decoded_hit(false)
     , _time_point(0)
-    { }
+    {
+      assert(config.IsValid());
+    }
 
   void Access(size_t address, size_t num_bytes) {
-    if (num_bytes == 1) {
-      Access(address);
-    } else if (num_bytes > 1) {
-      size_t end_address = address + num_bytes - 1;
+    if (num_bytes == 0) {
+      return;
+    }
 
-      // Align the two addresses to 64 byte boundary...
-      address = (address >> 6) << 6;
-      end_address = (end_address >> 6) << 6;
+    if (nullptr != _sink) {
+      Record(MemoryRequest::eKind_Access, address, num_bytes);
+      return;
+    }
 
-      Access(address);
-      while (address != end_address) {
-        assert(end_address > address);
-        assert((end_address - address) % 64 == 0);
+    _bytes_requested += num_bytes;
+    AccessLines(address, num_bytes);
+  }
 
-        Access(address);
-        address += 64;
-      }
+  // Same as Access for the compressed block at address, which may be
+  // served by the block buffer instead.
+  void AccessBlock(size_t address, size_t num_bytes) {
+    if (num_bytes == 0) {
+      return;
+    }
+
+    if (nullptr != _sink) {
+      Record(MemoryRequest::eKind_AccessBlock, address, num_bytes);
+      return;
     }
+
+    _bytes_requested += num_bytes;
+    if (!_block_buffer.empty() && BlockBufferLookup(address)) {
+      return;
+    }
+    AccessLines(address, num_bytes);
   }
 
   void Access(size_t address) {
-    _time_point++;
-    _num_accesses++;
+    if (nullptr != _sink) {
+      Record(MemoryRequest::eKind_Access, address, 1);
+      return;
+    }
 
-    // Align the address to a 64 byte boundary
-    address = (address >> 6) << 6;
-
-    // Search for matching cache lines...
-    CacheEntry *lru = NULL;
-    for (auto it = _lines.begin(); it != _lines.end(); ++it) {
-      CacheEntry &entry = *it;
-      if (entry._valid) {
-        if (entry._addr == address) {
-          _num_hits++;
-          entry._time = _time_point;
-          return;
-        }
+    _bytes_requested++;
+    const size_t offset = address & (_config.line_size - 1);
+    AccessLine((address >> _line_shift) << _line_shift, offset, offset);
+  }
 
-        if (nullptr == lru) {
-          // First entry we've encountered?
-          lru = &entry;
-        } else if (lru->_valid && entry._time < lru->_time) {
-          // LRU is valid and this one is worse
-          lru = &entry;
-        }
-      } else {
-        // Entry is invalid -- kick this one out first.
-        lru = &entry;
+  // Attributes the lines filled by subsequent accesses to owner.
+  void SetOwner(int owner) {
+    assert(owner >= 0 && owner <= 0xFFFF);
+    if (nullptr != _sink) {
+      Record(MemoryRequest::eKind_SetOwner, owner, 0);
+    }
+
+    _owner = owner;
+    if (static_cast<size_t>(owner) >= _owner_stats.size()) {
+      _owner_stats.resize(owner + 1);
+    }
+  }
+
+  // Per-owner fill and use, counting resident lines as if the cache were
+  // flushed at the end of the run.
+  std::vector<OwnerStats> GetOwnerStats() const {
+    std::vector<OwnerStats> result = _owner_stats;
+    for (size_t i = 0; i < _tags.size(); ++i) {
+      if (kInvalidTag != _tags[i]) {
+        result[_owners[i]].bytes_used += UsedBytes(i);
       }
     }
+    return result;
+  }
 
-    // OK, cache miss -- change the cache entry
-    _num_misses++;
-    lru->_addr = address;
-    lru->_time = _time_point;
-    lru->_valid = true;
+  // Marks the end of one texture sample. In banked mode this closes the
+  // current cycle every samples_per_cycle samples.
+  void EndSample() {
+    if (nullptr != _sink) {
+      Record(MemoryRequest::eKind_EndSample, 0, 0);
+      return;
+    }
+
+    if (_bank_counts.empty()) {
+      return;
+    }
+
+    _num_samples++;
+    if (++_cycle_samples == _config.samples_per_cycle) {
+      EndCycle();
+    }
+  }
+
+  // While a sink is set the cache only records: every request, owner
+  // change and sample is pushed to the sink instead of being simulated.
+  void SetSink(RequestSink *sink) { _sink = sink; }
+  bool IsRecording() const { return nullptr != _sink; }
+
+  // While a fill log is set, every fill from memory is appended to it as
+  // one request per run of filled sectors, owned by the current owner,
+  // e.g. to drive the next cache level.
+  void SetFillLog(std::vector<CacheRequest> *log) { _fill_log = log; }
+
+  // Records that the following requests belong to a sample of the given
+  // decoded block, so that replaying into a cache with a decoded block
+  // cache can skip them on a hit.
+  void RecordSample(size_t texture, const DecodedBlock &block) {
+    MemoryRequest request;
+    request.address = texture;
+    request.block = block;
+    request.num_bytes = 0;
+    request.kind = MemoryRequest::eKind_Sample;
+    _sink->Push(request);
+  }
+
+  // Batches skip the decoded block cache lookup that each sample needs,
+  // recordings need that lookup's block, and batched requests don't say
+  // which of them are blocks, so caches with any of these take their
+  // samples one at a time.
+  bool CanAccessBatch() const {
+    return nullptr == _decoded_cache && nullptr == _sink && _block_buffer.empty();
+  }
+
+  // Same as sending each request with its owner and sample boundary
+  // through SetOwner, Access and EndSample.
+  void AccessBatch(const CacheRequest *requests, size_t num_requests) {
+    assert(CanAccessBatch());
+    for (size_t i = 0; i < num_requests; ++i) {
+      const CacheRequest &r = requests[i];
+      if (r.owner != _owner) {
+        SetOwner(r.owner);
+      }
+      Access(r.address, r.num_bytes);
+      if (r.end_of_sample) {
+        EndSample();
+      }
+    }
+  }
+
+  // Simulates a recorded stream as if its requests had been sent directly.
+  // A stream may be replayed in chunks that split a sample's requests.
+  void Replay(const MemoryRequest *requests, size_t num_requests) {
+    for (size_t i = 0; i < num_requests; ++i) {
+      const MemoryRequest &r = requests[i];
+      switch (r.kind) {
+        case MemoryRequest::eKind_Access:
+          if (!_replay_decoded_hit) {
+            Access(r.address, r.num_bytes);
+          }
+          break;
+        case MemoryRequest::eKind_AccessBlock:
+          if (!_replay_decoded_hit) {
+            AccessBlock(r.address, r.num_bytes);
+          }
+          break;
+        case MemoryRequest::eKind_SetOwner:
+          SetOwner(static_cast<int>(r.address));
+          break;
+        case MemoryRequest::eKind_Sample:
+          _replay_decoded_hit = _decoded_cache && _decoded_cache->Lookup(r.address, r.block);
+          break;
+        case MemoryRequest::eKind_EndSample:
+          EndSample();
+          break;
+      }
+    }
+  }
+
+  const CacheConfig &GetConfig() const { return _config; }
+
+  // Sectors brought in from memory so far; cheaper than GetStats for
+  // telling whether a run of requests missed.
+  size_t GetNumSectorsFilled() const { return _num_sectors_filled; }
+  size_t GetNumAccesses() const { return _num_accesses; }
+  size_t GetNumHits() const { return _num_hits; }
+  size_t GetNumMisses() const { return _num_misses; }
+  size_t GetNumVictimHits() const { return _num_victim_hits; }
+
+  // The decoded block cache in front of this cache, or nullptr.
+  DecodedBlockCache *GetDecodedCache() const { return _decoded_cache.get(); }
+
+  CacheStats GetStats() const {
+    CacheStats stats;
+    stats.num_hits = _num_hits;
+    stats.num_misses = _num_misses;
+    stats.num_accesses = _num_accesses;
+    stats.num_sector_misses = _num_sector_misses;
+    stats.num_sectors_filled = _num_sectors_filled;
+    stats.num_victim_hits = _num_victim_hits;
+    stats.num_block_buffer_hits = _num_block_buffer_hits;
+    stats.num_decoded_hits = _decoded_cache ? _decoded_cache->GetNumHits() : 0;
+    stats.num_decodes = _decoded_cache ? _decoded_cache->GetNumDecodes() : 0;
+    stats.num_samples = _num_samples;
+    stats.num_cycles = _num_cycles;
+    stats.num_bank_stalls = _num_bank_stalls;
+    if (_cycle_samples > 0) {
+      // Count the partial cycle at the end of the run...
+      stats.num_cycles++;
+      stats.num_bank_stalls += CycleStalls();
+    }
+    stats.bytes_requested = _bytes_requested;
+    stats.bytes_filled = _num_sectors_filled * _config.sector_size;
+
+    stats.bytes_wasted = _bytes_wasted;
+    for (size_t i = 0; i < _tags.size(); ++i) {
+      if (kInvalidTag != _tags[i]) {
+        stats.bytes_wasted += FilledBytes(i) - UsedBytes(i);
+      }
+    }
+    return stats;
   }
 
-  void PrintStats() {
+  void PrintStats() const {
     std::cout << "Num cache hits: " << _num_hits << std::endl;
     std::cout << "Num cache misses: " << _num_misses << std::endl;
     std::cout << "Num cache accesses: " << _num_accesses << std::endl;
+    if (_config.sector_size < _config.line_size) {
+      std::cout << "Num sector misses: " << _num_sector_misses << std::endl;
+    }
+    std::cout << "Num sectors filled: " << _num_sectors_filled
+              << " (" << _config.sector_size << " bytes each)" << std::endl;
+    if (_config.victim_entries > 0) {
+      std::cout << "Num victim cache hits: " << _num_victim_hits << std::endl;
+    }
+    if (_config.block_buffer_entries > 0) {
+      std::cout << "Num block buffer hits: " << _num_block_buffer_hits << std::endl;
+    }
+    if (_decoded_cache) {
+      const size_t hits = _decoded_cache->GetNumHits();
+      const size_t samples = hits + _decoded_cache->GetNumMisses();
+      std::cout << "Num decoded cache hits: " << hits << " of " << samples << " samples ("
+                << _decoded_cache->GetCapacityInTexels() * 4 / 1024 << " KB at 4 bytes/texel)" << std::endl;
+      std::cout << "Num block decodes: " << _decoded_cache->GetNumDecodes();
+      if (samples > 0) {
+        std::cout << " (" << static_cast<double>(_decoded_cache->GetNumDecodes()) / samples
+                  << " per sample)";
+      }
+      std::cout << std::endl;
+    }
+
+    CacheStats stats = GetStats();
+    if (!_bank_counts.empty() && stats.num_cycles > 0) {
+      const size_t total_cycles = stats.num_cycles + stats.num_bank_stalls;
+      std::cout << "Num bank conflict stalls: " << stats.num_bank_stalls
+                << " over " << stats.num_cycles << " cycles" << std::endl;
+      std::cout << "Effective throughput: "
+                << static_cast<double>(stats.num_samples) / total_cycles
+                << " samples per cycle (peak " << _config.samples_per_cycle << ")" << std::endl;
+    }
+    std::cout << "Bytes requested: " << stats.bytes_requested << std::endl;
+    std::cout << "Bytes filled from memory: " << stats.bytes_filled << std::endl;
+    std::cout << "Bytes wasted: " << stats.bytes_wasted << std::endl;
+    if (stats.bytes_filled > stats.bytes_wasted) {
+      std::cout << "Overfetch ratio: "
+                << static_cast<double>(stats.bytes_filled) / (stats.bytes_filled - stats.bytes_wasted)
+                << std::endl;
+    }
   }
 
   void Clear() {
-    for (auto &entry : _lines) {
+    std::fill(_tags.begin(), _tags.end(), static_cast<uint64_t>(kInvalidTag));
+    std::fill(_times.begin(), _times.end(), 0);
+    std::fill(_sectors.begin(), _sectors.end(), 0);
+
+    _num_hits = _num_misses = _num_accesses = _time_point = 0;
+    _num_sector_misses = _num_sectors_filled = 0;
+    _num_victim_hits = _num_block_buffer_hits = 0;
+    for (auto &entry : _block_buffer) {
       entry._valid = false;
     }
+    if (_decoded_cache) {
+      _decoded_cache->Clear();
+    }
+    _num_samples = _num_cycles = _num_bank_stalls = 0;
+    _cycle_lines.clear();
+    _cycle_samples = 0;
+    _bytes_requested = _bytes_wasted = 0;
+    std::fill(_used_bytes.begin(), _used_bytes.end(), 0);
+    _owner = 0;
+    _owner_stats.assign(1, OwnerStats());
+    _replay_decoded_hit = false;
+  }
 
-    _num_hits = _num_misses = _num_accesses = _time_point = 0;
+  // Adds in a cache of the same configuration that simulated only the
+  // sets whose index modulo num_shards is shard. Merging every shard into
+  // a clear cache gives the state of simulating all the requests at once.
+  void MergeShard(const Cache &other, size_t shard, size_t num_shards) {
+    assert(_tags.size() == other._tags.size() && _num_ways > 0);
+    for (size_t set = shard; set < _num_sets; set += num_shards) {
+      const size_t begin = set * _num_ways;
+      const size_t end = begin + _num_ways;
+      std::copy(other._tags.begin() + begin, other._tags.begin() + end, _tags.begin() + begin);
+      std::copy(other._times.begin() + begin, other._times.begin() + end, _times.begin() + begin);
+      std::copy(other._sectors.begin() + begin, other._sectors.begin() + end, _sectors.begin() + begin);
+      std::copy(other._owners.begin() + begin, other._owners.begin() + end, _owners.begin() + begin);
+      std::copy(other._used_bytes.begin() + begin * _words_per_line,
+                other._used_bytes.begin() + end * _words_per_line,
+                _used_bytes.begin() + begin * _words_per_line);
+    }
+
+    _num_hits += other._num_hits;
+    _num_misses += other._num_misses;
+    _num_accesses += other._num_accesses;
+    _num_sector_misses += other._num_sector_misses;
+    _num_sectors_filled += other._num_sectors_filled;
+    _bytes_requested += other._bytes_requested;
+    _bytes_wasted += other._bytes_wasted;
+    _time_point = std::max(_time_point, other._time_point);
+    if (other._owner_stats.size() > _owner_stats.size()) {
+      _owner_stats.resize(other._owner_stats.size());
+    }
+    for (size_t i = 0; i < other._owner_stats.size(); ++i) {
+      _owner_stats[i].bytes_filled += other._owner_stats[i].bytes_filled;
+      _owner_stats[i].bytes_used += other._owner_stats[i].bytes_used;
+    }
   }
 
  private:
-  struct CacheEntry {
+  // Lines are line-aligned addresses, so no valid line has this tag.
+  static const uint64_t kInvalidTag = ~0ULL;
+
+  struct BlockBufferEntry {
+    BlockBufferEntry() : _addr(0), _time(0), _valid(false) { }
+
     size_t _addr;
     size_t _time;
     bool _valid;
   };
 
-  const int _size_in_kb;
-  std::vector<CacheEntry> _lines;
+  static int Log2(size_t x) {
+    int result = 0;
+    while ((static_cast<size_t>(1) << result) < x) {
+      result++;
+    }
+    return result;
+  }
+
+  static int PopCount(uint32_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcount(x);
+#else
+    int result = 0;
+    for (; x; x &= x - 1) {
+      result++;
+    }
+    return result;
+#endif
+  }
+
+  // Bits [first, last] set.
+  static uint32_t SectorMask(size_t first, size_t last) {
+    return ((2u << last) - 1) & ~((1u << first) - 1);
+  }
+
+  static int LowestSetBit(uint32_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(x);
+#else
+    int result = 0;
+    for (; !(x & 1); x >>= 1) {
+      result++;
+    }
+    return result;
+#endif
+  }
+
+  static int PopCount64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(x);
+#else
+    return PopCount(static_cast<uint32_t>(x)) + PopCount(static_cast<uint32_t>(x >> 32));
+#endif
+  }
+
+  // Marks bytes [lo, hi] of line idx as used.
+  void MarkUsed(size_t idx, size_t lo, size_t hi) {
+    uint64_t *words = &_used_bytes[idx * _words_per_line];
+    for (size_t w = lo / 64; w <= hi / 64; ++w) {
+      const size_t first = (w == lo / 64) ? lo % 64 : 0;
+      const size_t last = (w == hi / 64) ? hi % 64 : 63;
+      const uint64_t high = (last == 63) ? ~0ULL : ((1ULL << (last + 1)) - 1);
+      words[w] |= high & ~((1ULL << first) - 1);
+    }
+  }
+
+  size_t UsedBytes(size_t idx) const {
+    const uint64_t *words = &_used_bytes[idx * _words_per_line];
+    size_t used = 0;
+    for (size_t w = 0; w < _words_per_line; ++w) {
+      used += PopCount64(words[w]);
+    }
+    return used;
+  }
+
+  size_t FilledBytes(size_t idx) const {
+    return PopCount(_sectors[idx]) * _config.sector_size;
+  }
+
+  // Returns true if the block at address is in the block buffer, and
+  // makes it the most recently used entry either way.
+  bool BlockBufferLookup(size_t address) {
+    _time_point++;
+
+    BlockBufferEntry *lru = &_block_buffer[0];
+    for (auto &entry : _block_buffer) {
+      if (entry._valid && entry._addr == address) {
+        entry._time = _time_point;
+        _num_block_buffer_hits++;
+        return true;
+      }
+
+      if (lru->_valid && (!entry._valid || entry._time < lru->_time)) {
+        lru = &entry;
+      }
+    }
+
+    lru->_addr = address;
+    lru->_time = _time_point;
+    lru->_valid = true;
+    return false;
+  }
+
+  void Record(MemoryRequest::EKind kind, size_t address, size_t num_bytes) {
+    MemoryRequest request;
+    request.address = address;
+    request.block = DecodedBlock();
+    request.num_bytes = static_cast<uint32_t>(num_bytes);
+    request.kind = kind;
+    _sink->Push(request);
+  }
+
+  size_t GetBank(size_t line) const {
+    const size_t num_banks = _config.num_banks;
+    switch (_config.bank_hash) {
+      case eBankHash_Xor: {
+        // Fold the line index into bank-sized chunks. A single bank has
+        // no bits to fold into...
+        if (num_banks <= 1) {
+          return 0;
+        }
+        const int shift = Log2(num_banks);
+        size_t folded = 0;
+        for (; line; line >>= shift) {
+          folded ^= line & (num_banks - 1);
+        }
+        return folded;
+      }
+      case eBankHash_Modulo:
+        break;
+    }
+    return line % num_banks;
+  }
+
+  // Extra cycles the lines of the current cycle need: one per additional
+  // distinct line in the busiest bank.
+  size_t CycleStalls() const {
+    std::vector<size_t> &counts = _bank_counts;
+    std::fill(counts.begin(), counts.end(), 0);
+
+    size_t busiest = 0;
+    for (size_t line : _cycle_lines) {
+      busiest = std::max(busiest, ++counts[GetBank(line)]);
+    }
+    return busiest > 1 ? busiest - 1 : 0;
+  }
+
+  void EndCycle() {
+    _num_cycles++;
+    _num_bank_stalls += CycleStalls();
+    _cycle_lines.clear();
+    _cycle_samples = 0;
+  }
+
+  void SwapLines(size_t a, size_t b) {
+    std::swap(_tags[a], _tags[b]);
+    std::swap(_times[a], _times[b]);
+    std::swap(_sectors[a], _sectors[b]);
+    std::swap(_owners[a], _owners[b]);
+    std::swap_ranges(_used_bytes.begin() + a * _words_per_line,
+                     _used_bytes.begin() + (a + 1) * _words_per_line,
+                     _used_bytes.begin() + b * _words_per_line);
+  }
+
+  // The line in slot idx leaves the hierarchy: account for the bytes that
+  // were fetched but never used.
+  void RetireLine(size_t idx) {
+    const size_t used = UsedBytes(idx);
+    _bytes_wasted += FilledBytes(idx) - used;
+    _owner_stats[_owners[idx]].bytes_used += used;
+    _tags[idx] = kInvalidTag;
+    _times[idx] = 0;
+  }
+
+  // Moves the line in slot idx out of the cache, into the victim cache if
+  // there is one.
+  void EvictLine(size_t idx) {
+    if (_config.victim_entries == 0) {
+      RetireLine(idx);
+      return;
+    }
+
+    // Victim cache is LRU on insertion order...
+    const size_t victim = FindLRU(_num_lines, _tags.size());
+    if (kInvalidTag != _tags[victim]) {
+      RetireLine(victim);
+    }
+    SwapLines(idx, victim);
+    _times[victim] = _time_point;
+  }
+
+  // The victim cache slot holding address, or _tags.size() if it isn't
+  // there.
+  size_t FindVictim(size_t address) const {
+    return FindTag(_num_lines, _tags.size(), address);
+  }
+
+  // The slot in [begin, end) holding tag, or end.
+  size_t FindTag(size_t begin, size_t end, uint64_t tag) const {
+    return FindValue(_tags.data(), begin, end, tag);
+  }
+
+  // The first i in [begin, end) with values[i] == value, or end. Values
+  // are compared several at a time when the host has wide vectors, since
+  // the sets of a highly associative cache are long.
+  static size_t FindValue(const uint64_t *values, size_t begin, size_t end, uint64_t value) {
+    size_t i = begin;
+#if defined(__AVX512F__)
+    const __m512i key = _mm512_set1_epi64(static_cast<long long>(value));
+    for (; i + 8 <= end; i += 8) {
+      const __mmask8 match = _mm512_cmpeq_epi64_mask(_mm512_loadu_si512(values + i), key);
+      if (match) {
+        return i + LowestSetBit(match);
+      }
+    }
+#elif defined(__AVX2__)
+    const __m256i key = _mm256_set1_epi64x(static_cast<long long>(value));
+    for (; i + 8 <= end; i += 8) {
+      const __m256i lo = _mm256_cmpeq_epi64(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i)), key);
+      const __m256i hi = _mm256_cmpeq_epi64(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values + i + 4)), key);
+      const uint32_t match = static_cast<uint32_t>(
+        _mm256_movemask_pd(_mm256_castsi256_pd(lo)) |
+        (_mm256_movemask_pd(_mm256_castsi256_pd(hi)) << 4));
+      if (match) {
+        return i + LowestSetBit(match);
+      }
+    }
+#endif
+    for (; i < end; ++i) {
+      if (values[i] == value) {
+        return i;
+      }
+    }
+    return end;
+  }
+
+  // The least recently used slot in [begin, end). Invalid slots have time
+  // zero, so they are used first.
+  size_t FindLRU(size_t begin, size_t end) const {
+    const uint64_t *times = _times.data();
+#if defined(__AVX512F__)
+    // Find the oldest time with vector minimums, then its slot...
+    if (end - begin >= 8) {
+      __m512i oldest = _mm512_set1_epi64(-1);
+      size_t i = begin;
+      for (; i + 8 <= end; i += 8) {
+        oldest = _mm512_mask_min_epu64(oldest, 0xFF, oldest, _mm512_loadu_si512(times + i));
+      }
+
+      uint64_t lanes[8];
+      _mm512_storeu_si512(lanes, oldest);
+      uint64_t time = *std::min_element(lanes, lanes + 8);
+      for (; i < end; ++i) {
+        time = std::min<uint64_t>(time, times[i]);
+      }
+      return FindValue(times, begin, end, time);
+    }
+#endif
+    size_t lru = begin;
+    for (size_t i = begin + 1; i < end; ++i) {
+      if (times[i] < times[lru]) {
+        lru = i;
+      }
+    }
+    return lru;
+  }
+
+  // The line in slot idx is resident: fill any missing sectors and mark
+  // the accessed bytes. Returns true if no sectors were missing; counting
+  // the access is left to the caller.
+  bool AccessResidentLine(size_t idx, uint32_t sectors, size_t lo, size_t hi) {
+    _times[idx] = _time_point;
+
+    const uint32_t missing = sectors & ~_sectors[idx];
+    if (missing) {
+      // Line is here but some sectors aren't -- fill them.
+      _num_sectors_filled += PopCount(missing);
+      _owner_stats[_owners[idx]].bytes_filled += PopCount(missing) * _config.sector_size;
+      _sectors[idx] |= missing;
+      if (nullptr != _fill_log) {
+        LogFill(_tags[idx], missing);
+      }
+    }
+    MarkUsed(idx, lo, hi);
+    return 0 == missing;
+  }
+
+  // Touches each line of the request once with the sectors it covers.
+  void AccessLines(size_t address, size_t num_bytes) {
+    const size_t line_mask = _config.line_size - 1;
+    const size_t end_address = address + num_bytes - 1;
+    const size_t first_line = address >> _line_shift;
+    const size_t last_line = end_address >> _line_shift;
+    for (size_t line = first_line; line <= last_line; ++line) {
+      size_t lo = (line == first_line) ? (address & line_mask) : 0;
+      size_t hi = (line == last_line) ? (end_address & line_mask) : line_mask;
+      AccessLine(line << _line_shift, lo, hi);
+    }
+  }
+
+  // address is line aligned; bytes [lo, hi] of the line are accessed.
+  void AccessLine(size_t address, size_t lo, size_t hi) {
+    _time_point++;
+    _num_accesses++;
+
+    const uint32_t sectors = SectorMask(lo >> _sector_shift, hi >> _sector_shift);
+
+    if (!_bank_counts.empty()) {
+      // Requests for the same line within a cycle are merged...
+      const size_t line = address >> _line_shift;
+      if (std::find(_cycle_lines.begin(), _cycle_lines.end(), line) == _cycle_lines.end()) {
+        _cycle_lines.push_back(line);
+      }
+    }
+
+    // Search the line's set...
+    const size_t set_begin = ((address >> _line_shift) % _num_sets) * _num_ways;
+    const size_t set_end = set_begin + _num_ways;
+    const size_t hit = FindTag(set_begin, set_end, address);
+    if (hit != set_end) {
+      if (AccessResidentLine(hit, sectors, lo, hi)) {
+        _num_hits++;
+      } else {
+        _num_sector_misses++;
+      }
+      return;
+    }
+
+    const size_t idx = FindLRU(set_begin, set_end);
+
+    // Check the victim cache before going to memory...
+    if (_config.victim_entries > 0) {
+      const size_t victim = FindVictim(address);
+      if (victim != _tags.size()) {
+        _num_victim_hits++;
+        SwapLines(idx, victim);
+        if (kInvalidTag != _tags[victim]) {
+          _times[victim] = _time_point;
+        }
+        AccessResidentLine(idx, sectors, lo, hi);
+        return;
+      }
+    }
+
+    // OK, cache miss -- change the cache entry
+    if (kInvalidTag != _tags[idx]) {
+      EvictLine(idx);
+    }
+    std::fill(_used_bytes.begin() + idx * _words_per_line,
+              _used_bytes.begin() + (idx + 1) * _words_per_line, 0);
+    MarkUsed(idx, lo, hi);
+
+    _num_misses++;
+    _num_sectors_filled += PopCount(sectors);
+    _owner_stats[_owner].bytes_filled += PopCount(sectors) * _config.sector_size;
+    _owners[idx] = static_cast<uint16_t>(_owner);
+    _tags[idx] = address;
+    _times[idx] = _time_point;
+    _sectors[idx] = sectors;
+    if (nullptr != _fill_log) {
+      LogFill(address, sectors);
+    }
+  }
+
+  void LogFill(size_t address, uint32_t sectors) {
+    const uint64_t bits = sectors;
+    size_t first = 0;
+    while (bits >> first) {
+      if (0 == ((bits >> first) & 1)) {
+        first++;
+        continue;
+      }
+
+      size_t last = first;
+      while ((bits >> last) & 1) {
+        last++;
+      }
+      CacheRequest fill = {
+        address + first * _config.sector_size,
+        static_cast<uint32_t>((last - first) * _config.sector_size),
+        static_cast<uint16_t>(_owner), 0
+      };
+      _fill_log->push_back(fill);
+      first = last;
+    }
+  }
+
+  const CacheConfig _config;
+  const int _line_shift;
+  const int _sector_shift;
+  const size_t _words_per_line;
+  const size_t _num_lines;
+  const size_t _num_ways;
+  const size_t _num_sets;
+
+  // The tag store, one entry per line: the cache's sets one after the
+  // other, then the victim cache. Invalid lines have kInvalidTag.
+  std::vector<uint64_t> _tags;
+  std::vector<uint64_t> _times;
+  std::vector<uint32_t> _sectors;
+  std::vector<uint16_t> _owners;
+
+  // One bit per byte of each line, set when the byte is accessed.
+  std::vector<uint64_t> _used_bytes;
+
+  std::vector<BlockBufferEntry> _block_buffer;
+  std::unique_ptr<DecodedBlockCache> _decoded_cache;
+  RequestSink *_sink;
+  std::vector<CacheRequest> *_fill_log;
+
+  // Banked mode state: distinct lines touched in the current cycle and
+  // scratch space for counting them per bank.
+  mutable std::vector<size_t> _bank_counts;
+  std::vector<size_t> _cycle_lines;
+  size_t _cycle_samples;
   size_t _num_hits;
   size_t _num_misses;
   size_t _num_accesses;
+  size_t _num_sector_misses;
+  size_t _num_sectors_filled;
+  size_t _num_victim_hits;
+  size_t _num_block_buffer_hits;
+  size_t _num_samples;
+  size_t _num_cycles;
+  size_t _num_bank_stalls;
+  size_t _bytes_requested;
+  size_t _bytes_wasted;
+
+  int _owner;
+  std::vector<OwnerStats> _owner_stats;
+
+  // Whether the sample being replayed was served by the decoded block
+  // cache, so its requests are skipped. Kept across calls to Replay.
+  bool _replay_decoded_hit;
   size_t _time_point;
 };
 
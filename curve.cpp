@@ -0,0 +1,64 @@
+#include "curve.h"
+
+namespace {
+
+// Orientation states are two bits: bit 0 swaps x and y, bit 1 flips both
+// axes. The two commute, so composing orientations is an xor.
+const int kQuadrantX[4] = { 0, 0, 1, 1 };
+const int kQuadrantY[4] = { 0, 1, 1, 0 };
+const unsigned kQuadrantState[4] = { 1, 0, 0, 3 };
+
+struct HilbertTable {
+  HilbertTable() {
+    for (unsigned state = 0; state < 4; ++state) {
+      for (unsigned byte = 0; byte < 256; ++byte) {
+        unsigned s = state;
+        unsigned x = 0, y = 0;
+        for (int level = 3; level >= 0; --level) {
+          const unsigned q = (byte >> (2 * level)) & 0x3;
+          unsigned bx = kQuadrantX[q];
+          unsigned by = kQuadrantY[q];
+          if (s & 0x1) {
+            std::swap(bx, by);
+          }
+          if (s & 0x2) {
+            bx ^= 1;
+            by ^= 1;
+          }
+
+          x = (x << 1) | bx;
+          y = (y << 1) | by;
+          s ^= kQuadrantState[q];
+        }
+
+        _lut[(state << 8) | byte] = static_cast<uint16_t>(x | (y << 4) | (s << 8));
+      }
+    }
+  }
+
+  uint16_t _lut[4 * 256];
+};
+
+struct MortonTable {
+  MortonTable() {
+    for (unsigned byte = 0; byte < 256; ++byte) {
+      int x, y;
+      MortonDecode(byte, &x, &y);
+      _lut[byte] = static_cast<uint8_t>(x | (y << 4));
+    }
+  }
+
+  uint8_t _lut[256];
+};
+
+}  // namespace
+
+const uint8_t *MortonLUT() {
+  static const MortonTable table;
+  return table._lut;
+}
+
+const uint16_t *HilbertLUT() {
+  static const HilbertTable table;
+  return table._lut;
+}
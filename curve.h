@@ -0,0 +1,238 @@
+#ifndef __CURVE_H__
+#define __CURVE_H__
+
+#include <algorithm>
+#include <cstdint>
+
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Space filling curves used to order texel (and block) traversals. Both
+// curves are defined over a power-of-two square of side 2^order; the
+// Traverse* functions clip them to arbitrary w x h rectangles by skipping
+// whole aligned sub-squares that fall outside, so non-power-of-two and
+// non-square textures cost little more than their own area.
+
+static inline int CurveOrder(int w, int h) {
+  int order = 0;
+  while ((1 << order) < std::max(w, h)) {
+    order++;
+  }
+  return order;
+}
+
+static inline int CountTrailingZeros(uint64_t x) {
+#if defined(_MSC_VER)
+  unsigned long idx;
+  _BitScanForward64(&idx, x);
+  return static_cast<int>(idx);
+#else
+  return __builtin_ctzll(x);
+#endif
+}
+
+#if !defined(__BMI2__)
+// Gather the even bits of x into the low 16 bits.
+static inline uint32_t CompactEvenBits(uint32_t x) {
+  x &= 0x55555555;
+  x = (x ^ (x >> 1)) & 0x33333333;
+  x = (x ^ (x >> 2)) & 0x0F0F0F0F;
+  x = (x ^ (x >> 4)) & 0x00FF00FF;
+  x = (x ^ (x >> 8)) & 0x0000FFFF;
+  return x;
+}
+#endif
+
+// Even bits of the code are x, odd bits are y.
+static inline void MortonDecode(uint32_t code, int *x, int *y) {
+#if defined(__BMI2__)
+  *x = static_cast<int>(_pext_u32(code, 0x55555555));
+  *y = static_cast<int>(_pext_u32(code, 0xAAAAAAAA));
+#else
+  *x = static_cast<int>(CompactEvenBits(code));
+  *y = static_cast<int>(CompactEvenBits(code >> 1));
+#endif
+}
+
+// Lookup table that decodes the low byte of a Morton code: x in bits 0-3
+// and y in bits 4-7.
+const uint8_t *MortonLUT();
+
+// Lookup table that decodes four levels (one byte) of a Hilbert index at a
+// time. Indexed by (state << 8) | byte, each entry holds the x nibble in
+// bits 0-3, the y nibble in bits 4-7 and the next state in bits 8-9.
+const uint16_t *HilbertLUT();
+
+// Decodes a Hilbert index of a curve covering a 2^order square. The curve
+// starts at (0, 0) and ends at (2^order - 1, 0).
+static inline void HilbertDecode(const uint16_t *lut, uint64_t d, int order,
+                                 int *x, int *y) {
+  const int padded_order = (order + 3) & ~3;
+
+  // Leading zero digits swap the axes, so start from the orientation
+  // that cancels them out.
+  unsigned state = ((padded_order - order) & 1) ? 1 : 0;
+  int rx = 0, ry = 0;
+  for (int shift = 2 * padded_order - 8; shift >= 0; shift -= 8) {
+    uint16_t e = lut[(state << 8) | ((d >> shift) & 0xFF)];
+    rx = (rx << 4) | (e & 0xF);
+    ry = (ry << 4) | ((e >> 4) & 0xF);
+    state = e >> 8;
+  }
+  *x = rx;
+  *y = ry;
+}
+
+// The next index to try after d, whose point (x, y) lies outside w x h.
+// Indices that land outside are skipped a whole aligned block at a time:
+// indices [d, d + 4^j) with d a multiple of 4^j always cover an aligned
+// 2^j square for both curves.
+static inline uint64_t SkipOutside(uint64_t d, int x, int y, int w, int h) {
+  // (0, 0) is always inside, so d is nonzero here.
+  int j = CountTrailingZeros(d) / 2;
+  while (j > 0) {
+    const int mask = ~((1 << j) - 1);
+    if ((x & mask) >= w || (y & mask) >= h) {
+      break;
+    }
+    --j;
+  }
+  return d + (1ULL << (2 * j));
+}
+
+// Walks the curve produced by decode over a 2^order square, calling
+// fn(x, y) for every point inside w x h.
+template<typename Decode, typename Fn>
+static inline void TraverseCurve(int w, int h, Decode &decode, Fn &fn) {
+  if (w <= 0 || h <= 0) {
+    return;
+  }
+
+  const int order = CurveOrder(w, h);
+  const uint64_t num_points = 1ULL << (2 * order);
+  uint64_t d = 0;
+  while (d < num_points) {
+    int x, y;
+    decode(d, &x, &y);
+    if (x < w && y < h) {
+      fn(x, y);
+      ++d;
+      continue;
+    }
+    d = SkipOutside(d, x, y, w, h);
+  }
+}
+
+// The points TraverseCurve visits, handed out one at a time so that a
+// walk can be resumed.
+template<typename Decode>
+class CurveCursor {
+ public:
+  CurveCursor(int w, int h, const Decode &decode)
+    : _w(w), _h(h), _decode(decode)
+    , _num_points((w > 0 && h > 0) ? 1ULL << (2 * CurveOrder(w, h)) : 0), _d(0) { }
+
+  // The next point, or false once the curve is done.
+  bool Next(int *x, int *y) {
+    while (_d < _num_points) {
+      _decode(_d, x, y);
+      if (*x < _w && *y < _h) {
+        ++_d;
+        return true;
+      }
+      _d = SkipOutside(_d, *x, *y, _w, _h);
+    }
+    return false;
+  }
+
+ private:
+  const int _w;
+  const int _h;
+  Decode _decode;
+  const uint64_t _num_points;
+  uint64_t _d;
+};
+
+// Traversals visit indices in increasing order, so the decoders below
+// only redo the high digits when they change and decode the low byte of
+// each index with a single table lookup.
+struct MortonDecoder {
+  MortonDecoder() : _lut(MortonLUT()), _high(~0ULL), _high_x(0), _high_y(0) { }
+
+  void operator()(uint64_t d, int *x, int *y) {
+#if defined(__BMI2__)
+    MortonDecode(static_cast<uint32_t>(d), x, y);
+#else
+    if ((d >> 8) != _high) {
+      _high = d >> 8;
+      MortonDecode(static_cast<uint32_t>(d & ~0xFFULL), &_high_x, &_high_y);
+    }
+    const uint8_t e = _lut[d & 0xFF];
+    *x = _high_x | (e & 0xF);
+    *y = _high_y | (e >> 4);
+#endif
+  }
+
+  const uint8_t *_lut;
+  uint64_t _high;
+  int _high_x;
+  int _high_y;
+};
+
+struct HilbertDecoder {
+  HilbertDecoder(int w, int h)
+    : _lut(HilbertLUT()), _order(CurveOrder(w, h))
+    , _high(~0ULL), _high_x(0), _high_y(0), _state(0) { }
+
+  void operator()(uint64_t d, int *x, int *y) {
+    if ((d >> 8) != _high) {
+      _high = d >> 8;
+      DecodeHigh();
+    }
+    const uint16_t e = _lut[(_state << 8) | (d & 0xFF)];
+    *x = _high_x | (e & 0xF);
+    *y = _high_y | ((e >> 4) & 0xF);
+  }
+
+ private:
+  void DecodeHigh() {
+    const int padded_order = (_order + 3) & ~3;
+    unsigned state = ((padded_order - _order) & 1) ? 1 : 0;
+    int rx = 0, ry = 0;
+    for (int shift = 2 * padded_order - 16; shift >= 0; shift -= 8) {
+      uint16_t e = _lut[(state << 8) | ((_high >> shift) & 0xFF)];
+      rx = (rx << 4) | (e & 0xF);
+      ry = (ry << 4) | ((e >> 4) & 0xF);
+      state = e >> 8;
+    }
+    _high_x = rx << 4;
+    _high_y = ry << 4;
+    _state = state;
+  }
+
+  const uint16_t *_lut;
+  const int _order;
+  uint64_t _high;
+  int _high_x;
+  int _high_y;
+  unsigned _state;
+};
+
+template<typename Fn>
+static inline void TraverseMorton(int w, int h, Fn &fn) {
+  MortonDecoder decode;
+  TraverseCurve(w, h, decode, fn);
+}
+
+template<typename Fn>
+static inline void TraverseHilbert(int w, int h, Fn &fn) {
+  HilbertDecoder decode(w, h);
+  TraverseCurve(w, h, decode, fn);
+}
+
+#endif  // __CURVE_H__
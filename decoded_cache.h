@@ -0,0 +1,107 @@
+#ifndef __DECODED_CACHE_H__
+#define __DECODED_CACHE_H__
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+
+// The unit of decompression behind a texel: decoding it produces
+// num_texels texels at the cost of num_decodes ASTC block decodes.
+struct DecodedBlock {
+  size_t id;
+  int num_texels;
+  int num_decodes;
+};
+
+// LRU cache of decompressed blocks keyed by (texture, block id) rather
+// than by memory address, with its capacity measured in decoded texels.
+// A texel whose block is resident needs neither memory accesses nor a
+// decode.
+class DecodedBlockCache {
+ public:
+  explicit DecodedBlockCache(size_t capacity_in_texels)
+    : _capacity(capacity_in_texels)
+    , _texels_used(0)
+    , _num_hits(0)
+    , _num_misses(0)
+    , _num_decodes(0)
+  { }
+
+  // Returns true if the block is resident. Otherwise the block is decoded
+  // and inserted, evicting least recently used blocks to make room.
+  bool Lookup(size_t texture, const DecodedBlock &block) {
+    const Key key = { texture, block.id };
+    auto it = _map.find(key);
+    if (it != _map.end()) {
+      _num_hits++;
+      _lru.splice(_lru.begin(), _lru, it->second);
+      return true;
+    }
+
+    _num_misses++;
+    _num_decodes += block.num_decodes;
+
+    // Blocks bigger than the whole cache are decoded and dropped...
+    const size_t num_texels = static_cast<size_t>(block.num_texels);
+    if (num_texels > _capacity) {
+      return false;
+    }
+
+    while (_texels_used + num_texels > _capacity) {
+      const Entry &victim = _lru.back();
+      _texels_used -= victim.num_texels;
+      _map.erase(victim.key);
+      _lru.pop_back();
+    }
+
+    Entry entry = { key, num_texels };
+    _lru.push_front(entry);
+    _map[key] = _lru.begin();
+    _texels_used += num_texels;
+    return false;
+  }
+
+  size_t GetCapacityInTexels() const { return _capacity; }
+  size_t GetNumHits() const { return _num_hits; }
+  size_t GetNumMisses() const { return _num_misses; }
+  size_t GetNumDecodes() const { return _num_decodes; }
+
+  void Clear() {
+    _lru.clear();
+    _map.clear();
+    _texels_used = 0;
+    _num_hits = _num_misses = _num_decodes = 0;
+  }
+
+ private:
+  struct Key {
+    size_t texture;
+    size_t block;
+
+    bool operator==(const Key &other) const {
+      return texture == other.texture && block == other.block;
+    }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key &k) const {
+      return std::hash<size_t>()(k.texture * 0x9E3779B97F4A7C15ULL ^ k.block);
+    }
+  };
+
+  struct Entry {
+    Key key;
+    size_t num_texels;
+  };
+
+  const size_t _capacity;
+  size_t _texels_used;
+  std::list<Entry> _lru;
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> _map;
+
+  size_t _num_hits;
+  size_t _num_misses;
+  size_t _num_decodes;
+};
+
+#endif  // __DECODED_CACHE_H__
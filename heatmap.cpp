@@ -0,0 +1,188 @@
+#include "heatmap.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+namespace {
+
+// Largest payload of a stored deflate block.
+const size_t kMaxStoredBytes = 0xFFFF;
+
+// Continues the CRC-32 that PNG chunks end with over bytes.
+uint32_t UpdateCRC(uint32_t crc, const unsigned char *bytes, size_t num_bytes) {
+  struct Table {
+    Table() {
+      for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; ++k) {
+          c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+        }
+        values[n] = c;
+      }
+    }
+    uint32_t values[256];
+  };
+  static const Table kTable;
+
+  for (size_t i = 0; i < num_bytes; ++i) {
+    crc = kTable.values[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+// Writes a PNG one row at a time so that no more than a row of pixels is
+// ever in memory. The image data is a zlib stream of stored deflate
+// blocks, one IDAT chunk per row: the file is as big as the raw pixels,
+// but it needs neither the whole image nor a compressor.
+class PNGRowWriter {
+ public:
+  PNGRowWriter(FILE *file, int width, int height)
+    : _file(file), _width(width), _height(height), _num_rows(0), _adler_a(1), _adler_b(0)
+    , _ok(true) {
+    assert(width > 0 && height > 0);
+    static const unsigned char kSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    _ok = fwrite(kSignature, 1, sizeof(kSignature), _file) == sizeof(kSignature);
+
+    // 8-bit RGB, no interlacing...
+    std::vector<unsigned char> header;
+    Append32(&header, static_cast<uint32_t>(width));
+    Append32(&header, static_cast<uint32_t>(height));
+    const unsigned char kFormat[5] = { 8, 2, 0, 0, 0 };
+    header.insert(header.end(), kFormat, kFormat + 5);
+    WriteChunk("IHDR", header);
+  }
+
+  // Writes the next row of width RGB pixels.
+  void WriteRow(const unsigned char *pixels) {
+    assert(_num_rows < _height);
+    std::vector<unsigned char> &data = _chunk;
+    data.clear();
+    if (0 == _num_rows) {
+      // zlib header: deflate with a 32K window, no preset dictionary...
+      data.push_back(0x78);
+      data.push_back(0x01);
+    }
+
+    // Each row starts with its filter type, none...
+    const size_t row_bytes = 1 + static_cast<size_t>(_width) * 3;
+    _row.resize(row_bytes);
+    _row[0] = 0;
+    std::copy(pixels, pixels + row_bytes - 1, _row.begin() + 1);
+
+    _num_rows++;
+    for (size_t begin = 0; begin < row_bytes; begin += kMaxStoredBytes) {
+      const size_t num_bytes = std::min(kMaxStoredBytes, row_bytes - begin);
+      const bool last = (_num_rows == _height) && begin + num_bytes == row_bytes;
+      AppendStored(&data, &_row[begin], num_bytes, last);
+    }
+
+    if (_num_rows == _height) {
+      Append32(&data, (_adler_b << 16) | _adler_a);
+    }
+    WriteChunk("IDAT", data);
+  }
+
+  // Ends the file. Returns false if any of it couldn't be written.
+  bool Finish() {
+    assert(_num_rows == _height);
+    WriteChunk("IEND", std::vector<unsigned char>());
+    return _ok;
+  }
+
+ private:
+  static void Append32(std::vector<unsigned char> *out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      out->push_back(static_cast<unsigned char>(value >> shift));
+    }
+  }
+
+  // Appends bytes as a stored deflate block, and adds them to the
+  // Adler-32 checksum of the stream.
+  void AppendStored(std::vector<unsigned char> *out, const unsigned char *bytes, size_t num_bytes,
+                    bool last) {
+    assert(num_bytes <= kMaxStoredBytes);
+    const uint16_t len = static_cast<uint16_t>(num_bytes);
+    const uint16_t nlen = static_cast<uint16_t>(~len);
+    out->push_back(last ? 1 : 0);
+    out->push_back(static_cast<unsigned char>(len));
+    out->push_back(static_cast<unsigned char>(len >> 8));
+    out->push_back(static_cast<unsigned char>(nlen));
+    out->push_back(static_cast<unsigned char>(nlen >> 8));
+    out->insert(out->end(), bytes, bytes + num_bytes);
+
+    for (size_t i = 0; i < num_bytes; ++i) {
+      _adler_a = (_adler_a + bytes[i]) % 65521;
+      _adler_b = (_adler_b + _adler_a) % 65521;
+    }
+  }
+
+  void WriteChunk(const char *type, const std::vector<unsigned char> &data) {
+    std::vector<unsigned char> length;
+    Append32(&length, static_cast<uint32_t>(data.size()));
+
+    uint32_t crc = UpdateCRC(0xFFFFFFFFu, reinterpret_cast<const unsigned char *>(type), 4);
+    crc = UpdateCRC(crc, data.data(), data.size());
+    std::vector<unsigned char> trailer;
+    Append32(&trailer, crc ^ 0xFFFFFFFFu);
+
+    _ok = _ok && fwrite(length.data(), 1, 4, _file) == 4 && fwrite(type, 1, 4, _file) == 4 &&
+      fwrite(data.data(), 1, data.size(), _file) == data.size() &&
+      fwrite(trailer.data(), 1, 4, _file) == 4;
+  }
+
+  FILE *_file;
+  const int _width;
+  const int _height;
+  int _num_rows;
+  uint32_t _adler_a;
+  uint32_t _adler_b;
+  bool _ok;
+  std::vector<unsigned char> _row;
+  std::vector<unsigned char> _chunk;
+};
+
+}  // namespace
+
+Heatmap::Heatmap(int width, int height, int cell_size)
+  : _cell_size(cell_size)
+  , _num_cells_x((width + cell_size - 1) / cell_size)
+  , _num_cells_y((height + cell_size - 1) / cell_size) {
+  assert(width > 0 && height > 0 && cell_size > 0);
+  Clear();
+}
+
+void Heatmap::Clear() {
+  const Counts kZero = { 0, 0 };
+  _counts.assign(static_cast<size_t>(_num_cells_x) * _num_cells_y, kZero);
+}
+
+bool Heatmap::WritePNG(const char *filename) const {
+  FILE *file = fopen(filename, "wb");
+  if (nullptr == file) {
+    return false;
+  }
+
+  PNGRowWriter writer(file, _num_cells_x, _num_cells_y);
+  std::vector<unsigned char> row(static_cast<size_t>(_num_cells_x) * 3);
+  for (int y = 0; y < _num_cells_y; ++y) {
+    std::fill(row.begin(), row.end(), 0);
+    const Counts *counts = &_counts[static_cast<size_t>(y) * _num_cells_x];
+    for (int x = 0; x < _num_cells_x; ++x) {
+      const int total = counts[x].hits + counts[x].misses;
+      if (0 == total) {
+        continue;
+      }
+
+      // Red rises over the first half of the miss rate, green falls over
+      // the second...
+      const double miss_rate = static_cast<double>(counts[x].misses) / total;
+      row[3 * x + 0] = static_cast<unsigned char>(255.0 * std::min(1.0, 2.0 * miss_rate));
+      row[3 * x + 1] = static_cast<unsigned char>(255.0 * std::min(1.0, 2.0 - 2.0 * miss_rate));
+    }
+    writer.WriteRow(row.data());
+  }
+
+  const bool ok = writer.Finish();
+  return 0 == fclose(file) && ok;
+}
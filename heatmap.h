@@ -0,0 +1,48 @@
+#ifndef __HEATMAP_H__
+#define __HEATMAP_H__
+
+#include <cstdint>
+#include <vector>
+
+// Hit and miss counts of the samples taken in each cell of a grid laid
+// over a texture, written out as an image whose colors show the miss
+// rate. The image is written a row at a time, so only the counters grow
+// with the texture: four bytes per cell.
+class Heatmap {
+ public:
+  Heatmap(int width, int height, int cell_size);
+
+  // A sample of texel (x, y) that hit or missed.
+  void Record(int x, int y, bool hit) {
+    Counts &counts = _counts[(y / _cell_size) * _num_cells_x + x / _cell_size];
+    uint16_t &count = hit ? counts.hits : counts.misses;
+    if (0xFFFF == count) {
+      // Halve both counts rather than saturate so the miss rate holds...
+      counts.hits /= 2;
+      counts.misses /= 2;
+    }
+    count++;
+  }
+
+  void Clear();
+
+  int GetCellSize() const { return _cell_size; }
+
+  // Writes the heatmap as an uncompressed PNG going from green for cells
+  // that always hit through yellow to red for cells that always miss.
+  // Unsampled cells are black. Returns false if the file can't be written.
+  bool WritePNG(const char *filename) const;
+
+ private:
+  struct Counts {
+    uint16_t hits;
+    uint16_t misses;
+  };
+
+  int _cell_size;
+  int _num_cells_x;
+  int _num_cells_y;
+  std::vector<Counts> _counts;
+};
+
+#endif  // __HEATMAP_H__
@@ -1,75 +1,861 @@
 #include <iostream>
+#include <iomanip>
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "cache.h"
 #include "texture.h"
 #include "access_pattern.h"
+#include "block_type_stats.h"
+#include "heatmap.h"
+#include "multicore.h"
+#include "profiler.h"
+#include "scene.h"
+#include "shard.h"
+#include "sweep.h"
+#include "trace.h"
 
 static void PrintUsageAndExit() {
-  std::cerr << "Usage: <<4x4|12x12> metadata_file vis_file | <ASTC4x4|ASTC8x8|ASTCx4|ASTC4x4> w h" << std::endl;
+  std::cerr << "Usage: [options] <texture> | scene <texture> [<texture> ...] | trace <trace_file> <texture> [<texture> ...]" << std::endl;
+  std::cerr << "  where <texture> is <4x4|12x12> metadata_file vis_file | <ASTC4x4|ASTC6x6|ASTC8x8|ASTC12x12> w h" << std::endl;
+  std::cerr << "Options:" << std::endl;
+  std::cerr << "  --cache-kb=N        cache size in KB (default 1)" << std::endl;
+  std::cerr << "  --line-size=N       cache line size in bytes (default 64)" << std::endl;
+  std::cerr << "  --sector-size=N     sector size in bytes, equal to the line size if unsectored" << std::endl;
+  std::cerr << "  --ways=N            N-way set associative (default fully associative)" << std::endl;
+  std::cerr << "  --victim-entries=N  add an N-line fully-associative victim cache" << std::endl;
+  std::cerr << "  --block-buffer=N    add an N-entry buffer of recently requested blocks in front of the cache (metadata bypasses it)" << std::endl;
+  std::cerr << "  --decoded-texels=N  add a decoded block cache holding N texels" << std::endl;
+  std::cerr << "  --banks=N           bank the cache into N banks and report conflicts" << std::endl;
+  std::cerr << "  --bank-hash=H       map lines to banks by 'modulo' (default) or 'xor'" << std::endl;
+  std::cerr << "  --samples-per-cycle=N  samples grouped into one cycle in banked mode (default 4)" << std::endl;
+  std::cerr << "  --packing=P         adaptive block packing: unaligned (default), line-aligned," << std::endl;
+  std::cerr << "                      power-of-two or grouped-by-type" << std::endl;
+  std::cerr << "  --block-order=O     store adaptive blocks in raster (default), morton, hilbert" << std::endl;
+  std::cerr << "                      or first-touch order" << std::endl;
+  std::cerr << "  --training-trace=F  trace whose first touches give the first-touch order" << std::endl;
+  std::cerr << "  --metadata=M        adaptive metadata encoding: flat (default), bit-packed," << std::endl;
+  std::cerr << "                      delta-tile or hierarchical" << std::endl;
+  std::cerr << "  --sweep-kb=N,...     simulate every listed cache size over one address stream" << std::endl;
+  std::cerr << "  --sweep-line-size=N,...  ... and every listed line size" << std::endl;
+  std::cerr << "  --threads=N         worker threads for sweeps (default: all cores)" << std::endl;
+  std::cerr << "  --seed=N            seed of the random and stochastic access patterns (default 1)" << std::endl;
+  std::cerr << "  --walk-step=S       step scale of the random walk pattern in pixels (default 2)" << std::endl;
+  std::cerr << "  --walk-distribution=D  random walk steps are 'gaussian' (default) or 'cauchy'" << std::endl;
+  std::cerr << "  --jitter=S          standard deviation of the morton jitter pattern's offsets (default 4)" << std::endl;
+  std::cerr << "  --hot-spots=N       hot spots of the hot spot pattern (default 8)" << std::endl;
+  std::cerr << "  --hot-spot-radius=S standard deviation of the samples around a hot spot (default 16)" << std::endl;
+  std::cerr << "  --hot-spot-weight=P fraction of samples taken around hot spots (default 0.9)" << std::endl;
+  std::cerr << "  --wavefronts=K      run K wavefronts of the access patterns concurrently (default 1)" << std::endl;
+  std::cerr << "  --wavefront-samples=N  consecutive samples handed to a wavefront at a time (default 64)" << std::endl;
+  std::cerr << "  --interleave=N      samples a wavefront issues per turn (default 1)" << std::endl;
+  std::cerr << "  --schedule=S        wavefront turns are 'round-robin' (default) or 'greedy-then-oldest'" << std::endl;
+  std::cerr << "  --cores=N           give N cores private L1s in front of a shared L2 (default 1)" << std::endl;
+  std::cerr << "  --core-tile=N       side of the screen tiles dealt to the cores (default 16)" << std::endl;
+  std::cerr << "  --l2-kb=N           shared L2 size in KB (default 64)" << std::endl;
+  std::cerr << "  --l2-ways=N         shared L2 associativity (default 16)" << std::endl;
+  std::cerr << "  --shards=N          simulate the sets of a set-associative cache on N threads" << std::endl;
+  std::cerr << "  --heatmap=P         write per-block miss rate heatmaps of each run to P-<run>-<texture>.png" << std::endl;
+  std::cerr << "  --heatmap-cell=N    side of the heatmap cells in texels (default: the block size)" << std::endl;
+  std::cerr << "  --block-type-stats  break down the cache behaviour of adaptive textures by block type" << std::endl;
+  std::cerr << "  --profile           report time and hardware counters (of all threads) per phase" << std::endl;
   exit(1);
 }
 
-int main(int argc, char **argv) {
-  if (argc == 1) { PrintUsageAndExit(); }
+// Parses arg if it has the form "--name=value". Returns false if arg is a
+// different option.
+static bool ParseSizeOption(const char *arg, const char *name, size_t *value) {
+  const size_t len = strlen(name);
+  if (strncmp(arg, name, len) != 0 || arg[len] != '=') {
+    return false;
+  }
+
+  char *end = nullptr;
+  long long result = strtoll(arg + len + 1, &end, 10);
+  if (end == arg + len + 1 || *end != '\0' || result <= 0) {
+    PrintUsageAndExit();
+  }
+  *value = static_cast<size_t>(result);
+  return true;
+}
 
-  std::unique_ptr<Texture> tex = nullptr;
-  if (strncmp(argv[1], "ASTC", 4) == 0) {
+// Parses arg if it has the form "--name=value" with any unsigned 64-bit
+// value, zero included. Returns false if arg is a different option.
+static bool ParseUnsignedOption(const char *arg, const char *name, uint64_t *value) {
+  const size_t len = strlen(name);
+  if (strncmp(arg, name, len) != 0 || arg[len] != '=') {
+    return false;
+  }
 
-    if (argc != 4) { PrintUsageAndExit(); }
+  // strtoull would wrap a negative value around...
+  const char *digits = arg + len + 1;
+  char *end = nullptr;
+  unsigned long long result = strtoull(digits, &end, 10);
+  if (end == digits || *end != '\0' || *digits == '-') {
+    PrintUsageAndExit();
+  }
+  *value = static_cast<uint64_t>(result);
+  return true;
+}
 
-    int w = atoi(argv[2]);
-    int h = atoi(argv[3]);
+// Parses arg if it has the form "--name=v1,v2,...". Returns false if arg
+// is a different option.
+static bool ParseSizeListOption(const char *arg, const char *name, std::vector<size_t> *values) {
+  const size_t len = strlen(name);
+  if (strncmp(arg, name, len) != 0 || arg[len] != '=') {
+    return false;
+  }
 
-    if(std::string(argv[1]) == std::string("ASTC4x4")) {
-      tex = Texture::Create(eTextureType_ASTC4x4, w, h);
-    } else if(std::string(argv[1]) == std::string("ASTC8x8")) {
-      tex = Texture::Create(eTextureType_ASTC8x8, w, h);
-    } else if(std::string(argv[1]) == std::string("ASTC6x6")) {
-      tex = Texture::Create(eTextureType_ASTC6x6, w, h);
-    } else if(std::string(argv[1]) == std::string("ASTC12x12")) {
-      tex = Texture::Create(eTextureType_ASTC12x12, w, h);
+  const char *p = arg + len + 1;
+  for (;;) {
+    char *end = nullptr;
+    long long result = strtoll(p, &end, 10);
+    if (end == p || (*end != ',' && *end != '\0') || result <= 0) {
+      PrintUsageAndExit();
+    }
+    values->push_back(static_cast<size_t>(result));
+    if (*end == '\0') {
+      return true;
     }
-  } else if (strncmp(argv[1], "4x4", 3) == 0) {
+    p = end + 1;
+  }
+}
 
-    if (argc != 4) { PrintUsageAndExit(); }
-    tex = Texture::Create(eTextureType_Adaptive4x4, argv[2], argv[3]);
+// Parses one texture description starting at argv[*idx] and advances *idx
+// past it. Returns nullptr if the description is malformed.
+static std::unique_ptr<Texture> ParseTexture(int argc, char **argv, int *idx,
+                                             const LayoutOptions &layout) {
+  int i = *idx;
+  if (i + 2 >= argc) {
+    return nullptr;
+  }
+  *idx = i + 3;
 
-  } else if (strncmp(argv[1], "12x12", 5) == 0) {
+  if (strncmp(argv[i], "ASTC", 4) == 0) {
 
-    if (argc != 4) { PrintUsageAndExit(); }
-    tex = Texture::Create(eTextureType_Adaptive12x12, argv[2], argv[3]);
+    int w = atoi(argv[i + 1]);
+    int h = atoi(argv[i + 2]);
 
-  } else {
+    if(std::string(argv[i]) == std::string("ASTC4x4")) {
+      return Texture::Create(eTextureType_ASTC4x4, w, h);
+    } else if(std::string(argv[i]) == std::string("ASTC8x8")) {
+      return Texture::Create(eTextureType_ASTC8x8, w, h);
+    } else if(std::string(argv[i]) == std::string("ASTC6x6")) {
+      return Texture::Create(eTextureType_ASTC6x6, w, h);
+    } else if(std::string(argv[i]) == std::string("ASTC12x12")) {
+      return Texture::Create(eTextureType_ASTC12x12, w, h);
+    }
+  } else if (strncmp(argv[i], "4x4", 3) == 0) {
+    return Texture::Create(eTextureType_Adaptive4x4, argv[i + 1], argv[i + 2], layout);
+  } else if (strncmp(argv[i], "12x12", 5) == 0) {
+    return Texture::Create(eTextureType_Adaptive12x12, argv[i + 1], argv[i + 2], layout);
+  }
+
+  return nullptr;
+}
+
+// Parses arg if it has the form "--name=value" with a non-negative real
+// value. Returns false if arg is a different option.
+static bool ParseRealOption(const char *arg, const char *name, double *value) {
+  const size_t len = strlen(name);
+  if (strncmp(arg, name, len) != 0 || arg[len] != '=') {
+    return false;
+  }
+
+  char *end = nullptr;
+  double result = strtod(arg + len + 1, &end);
+  if (end == arg + len + 1 || *end != '\0' || !(result >= 0.0)) {
     PrintUsageAndExit();
   }
+  *value = result;
+  return true;
+}
 
-  // 1KB cache...
-  Cache c(1);
+// Parses "--schedule=name". Returns false if arg is a different option.
+static bool ParseScheduleOption(const char *arg, EWavefrontSchedule *schedule) {
+  const char *kPrefix = "--schedule=";
+  if (strncmp(arg, kPrefix, strlen(kPrefix)) != 0) {
+    return false;
+  }
 
-  // Generate three different access patterns...
-  std::unique_ptr<AccessPattern> ap = AccessPattern::Create(eAccessPattern_Random);
-  ap->Run(tex, &c);
-  std::cout << "Cache stats for random access pattern: " << std::endl;
-  c.PrintStats();
-  std::cout << std::endl;
-  c.Clear();
+  for (int i = 0; i < kNumWavefrontSchedules; ++i) {
+    EWavefrontSchedule sch = static_cast<EWavefrontSchedule>(i);
+    if (strcmp(arg + strlen(kPrefix), GetWavefrontScheduleName(sch)) == 0) {
+      *schedule = sch;
+      return true;
+    }
+  }
 
-  ap = AccessPattern::Create(eAccessPattern_Morton);
-  ap->Run(tex, &c);
-  std::cout << "Cache stats for morton access pattern: " << std::endl;
-  c.PrintStats();
-  std::cout << std::endl;
-  c.Clear();
+  PrintUsageAndExit();
+  return false;
+}
+
+// Parses "--walk-distribution=name". Returns false if arg is a different
+// option.
+static bool ParseStepDistributionOption(const char *arg, EStepDistribution *distribution) {
+  const char *kPrefix = "--walk-distribution=";
+  if (strncmp(arg, kPrefix, strlen(kPrefix)) != 0) {
+    return false;
+  }
+
+  for (int i = 0; i < kNumStepDistributions; ++i) {
+    EStepDistribution d = static_cast<EStepDistribution>(i);
+    if (strcmp(arg + strlen(kPrefix), GetStepDistributionName(d)) == 0) {
+      *distribution = d;
+      return true;
+    }
+  }
+
+  PrintUsageAndExit();
+  return false;
+}
+
+// Parses "--packing=name". Returns false if arg is a different option.
+static bool ParsePackingOption(const char *arg, ELayoutPacking *packing) {
+  const char *kPrefix = "--packing=";
+  if (strncmp(arg, kPrefix, strlen(kPrefix)) != 0) {
+    return false;
+  }
+
+  for (int i = 0; i < kNumLayoutPackings; ++i) {
+    ELayoutPacking p = static_cast<ELayoutPacking>(i);
+    if (strcmp(arg + strlen(kPrefix), GetLayoutPackingName(p)) == 0) {
+      *packing = p;
+      return true;
+    }
+  }
+
+  PrintUsageAndExit();
+  return false;
+}
+
+// Parses "--block-order=name". Returns false if arg is a different option.
+static bool ParseBlockOrderOption(const char *arg, EBlockOrder *order) {
+  const char *kPrefix = "--block-order=";
+  if (strncmp(arg, kPrefix, strlen(kPrefix)) != 0) {
+    return false;
+  }
+
+  for (int i = 0; i < kNumBlockOrders; ++i) {
+    EBlockOrder o = static_cast<EBlockOrder>(i);
+    if (strcmp(arg + strlen(kPrefix), GetBlockOrderName(o)) == 0) {
+      *order = o;
+      return true;
+    }
+  }
+
+  PrintUsageAndExit();
+  return false;
+}
+
+// Parses "--metadata=name". Returns false if arg is a different option.
+static bool ParseMetadataOption(const char *arg, EMetadataEncoding *encoding) {
+  const char *kPrefix = "--metadata=";
+  if (strncmp(arg, kPrefix, strlen(kPrefix)) != 0) {
+    return false;
+  }
+
+  for (int i = 0; i < kNumMetadataEncodings; ++i) {
+    EMetadataEncoding e = static_cast<EMetadataEncoding>(i);
+    if (strcmp(arg + strlen(kPrefix), GetMetadataEncodingName(e)) == 0) {
+      *encoding = e;
+      return true;
+    }
+  }
+
+  PrintUsageAndExit();
+  return false;
+}
+
+// How well the stored blocks of each texture fit the cache lines.
+static void PrintLayoutStats(const Scene &scene, const LayoutOptions &layout) {
+  for (size_t i = 0; i < scene.GetNumTextures(); ++i) {
+    const std::unique_ptr<Texture> &tex = scene.GetTexture(i);
+    const LayoutStats stats = tex->GetLayoutStats();
+    if (0 == stats.num_blocks) {
+      continue;
+    }
+
+    std::cout << "Layout of texture " << i << " (" << GetTextureTypeName(tex->GetType())
+              << ", " << GetLayoutPackingName(layout.packing) << "): " << std::endl;
+    std::cout << "Num stored blocks: " << stats.num_blocks << std::endl;
+    std::cout << "Padding: " << stats.padding_bytes << " bytes ("
+              << (100.0 * stats.padding_bytes) / stats.payload_bytes << "% of payload)" << std::endl;
+    std::cout << "Blocks crossing an extra line: " << stats.num_line_crossings << std::endl;
+    std::cout << "Lines per block: "
+              << static_cast<double>(stats.num_lines_touched) / stats.num_blocks << std::endl;
+    std::cout << "Metadata (" << GetMetadataEncodingName(layout.metadata) << "): "
+              << tex->GetMetadataSizeInBytes() << " bytes, "
+              << stats.metadata_fetches_per_lookup << " dependent fetches and "
+              << stats.metadata_decode_ops_per_lookup << " decode ops per lookup" << std::endl;
+    std::cout << std::endl;
+  }
+}
+
+// Compressed footprint of the scene and the DRAM efficiency of a run
+// that produced num_pixels texture samples.
+static void PrintTrafficStats(const Scene &scene, const Cache &c, size_t num_pixels) {
+  size_t size = 0, metadata_size = 0, num_texels = 0;
+  for (size_t i = 0; i < scene.GetNumTextures(); ++i) {
+    const std::unique_ptr<Texture> &tex = scene.GetTexture(i);
+    size += tex->GetSizeInBytes();
+    metadata_size += tex->GetMetadataSizeInBytes();
+    num_texels += static_cast<size_t>(tex->GetWidth()) * tex->GetHeight();
+  }
+
+  const CacheStats stats = c.GetStats();
+  std::cout << "Compressed size: " << size << " bytes (" << metadata_size
+            << " bytes metadata), " << (8.0 * size) / num_texels << " bits per texel" << std::endl;
+  if (num_pixels > 0) {
+    std::cout << "DRAM bytes per pixel: "
+              << static_cast<double>(stats.bytes_filled) / num_pixels << std::endl;
+    std::cout << "Wasted DRAM bytes per pixel: "
+              << static_cast<double>(stats.bytes_wasted) / num_pixels << std::endl;
+  }
+}
 
-  ap = AccessPattern::Create(eAccessPattern_Raster);
-  ap->Run(tex, &c);
-  std::cout << "Cache stats for raster access pattern: " << std::endl;
-  c.PrintStats();
+// Bytes fetched per byte used for each texture (rows) in each run
+// (columns).
+static void PrintOverfetchTable(const Scene &scene, const std::vector<std::string> &run_names,
+                                const std::vector<std::vector<OwnerStats> > &runs) {
+  std::cout << "Overfetch ratio (bytes filled / bytes used):" << std::endl;
+  std::cout << std::setw(24) << std::left << "texture";
+  for (const std::string &name : run_names) {
+    std::cout << std::setw(14) << std::right << name;
+  }
   std::cout << std::endl;
-  c.Clear();
+
+  for (size_t i = 0; i < scene.GetNumTextures(); ++i) {
+    std::string name = std::to_string(i) + ": " + GetTextureTypeName(scene.GetTexture(i)->GetType());
+    std::cout << std::setw(24) << std::left << name;
+    for (const std::vector<OwnerStats> &run : runs) {
+      std::cout << std::setw(14) << std::right << std::fixed << std::setprecision(3)
+                << (i < run.size() ? run[i].GetOverfetchRatio() : 0.0);
+    }
+    std::cout << std::endl;
+  }
+  std::cout.unsetf(std::ios::floatfield);
+  std::cout << std::setprecision(6);
+}
+
+// Prints the block type stats of each texture of the scene that has them
+// and clears them for the next run. Samples are counted per block, the
+// other columns count cache lines as the cache stats do; the victim hit
+// columns are only shown when c has a victim cache.
+static void PrintBlockTypeStats(const Scene &scene, const Cache &c) {
+  const bool victim = c.GetConfig().victim_entries > 0;
+  for (size_t i = 0; i < scene.GetNumTextures(); ++i) {
+    BlockTypeStats *stats = scene.GetTexture(i)->GetBlockTypeStats();
+    if (nullptr == stats) {
+      continue;
+    }
+
+    size_t total_misses = 0;
+    for (size_t t = 0; t < stats->GetNumTypes(); ++t) {
+      for (int part = 0; part < BlockTypeStats::kNumParts; ++part) {
+        total_misses += stats->GetCounts(t, static_cast<BlockTypeStats::EPart>(part)).num_misses;
+      }
+    }
+
+    std::cout << "Block types of texture " << i << " ("
+              << GetTextureTypeName(scene.GetTexture(i)->GetType()) << "):" << std::endl;
+    std::cout << std::setw(12) << std::left << "type" << std::right
+              << std::setw(12) << "samples"
+              << std::setw(12) << "meta lines"
+              << std::setw(12) << "meta hits" << std::setw(12) << "meta misses";
+    if (victim) {
+      std::cout << std::setw(12) << "meta victim";
+    }
+    std::cout << std::setw(12) << "meta bytes"
+              << std::setw(12) << "lines"
+              << std::setw(12) << "hits" << std::setw(12) << "misses";
+    if (victim) {
+      std::cout << std::setw(12) << "victim hits";
+    }
+    std::cout << std::setw(12) << "bytes"
+              << std::setw(12) << "% misses" << std::endl;
+    for (size_t t = 0; t < stats->GetNumTypes(); ++t) {
+      const BlockTypeStats::Counts &metadata = stats->GetCounts(t, BlockTypeStats::ePart_Metadata);
+      const BlockTypeStats::Counts &payload = stats->GetCounts(t, BlockTypeStats::ePart_Payload);
+      const size_t misses = metadata.num_misses + payload.num_misses;
+      std::cout << std::setw(12) << std::left << stats->GetTypeName(t) << std::right
+                << std::setw(12) << payload.num_samples
+                << std::setw(12) << metadata.num_lines
+                << std::setw(12) << metadata.num_hits << std::setw(12) << metadata.num_misses;
+      if (victim) {
+        std::cout << std::setw(12) << metadata.num_victim_hits;
+      }
+      std::cout << std::setw(12) << metadata.bytes_filled
+                << std::setw(12) << payload.num_lines
+                << std::setw(12) << payload.num_hits << std::setw(12) << payload.num_misses;
+      if (victim) {
+        std::cout << std::setw(12) << payload.num_victim_hits;
+      }
+      std::cout << std::setw(12) << payload.bytes_filled
+                << std::setw(12) << std::fixed << std::setprecision(2)
+                << (total_misses ? 100.0 * misses / total_misses : 0.0) << std::endl;
+      std::cout.unsetf(std::ios::floatfield);
+      std::cout << std::setprecision(6);
+    }
+    stats->Clear();
+  }
+}
+
+// Writes the heatmap of each texture of the scene for the named run and
+// clears it for the next one.
+static void WriteHeatmaps(const Scene &scene, const char *prefix, const std::string &run_name) {
+  std::string run = run_name;
+  std::replace(run.begin(), run.end(), ' ', '-');
+  for (size_t i = 0; i < scene.GetNumTextures(); ++i) {
+    Heatmap *heatmap = scene.GetTexture(i)->GetHeatmap();
+    const std::string filename = std::string(prefix) + "-" + run + "-" + std::to_string(i) + ".png";
+    if (!heatmap->WritePNG(filename.c_str())) {
+      std::cerr << "Error writing " << filename << std::endl;
+      exit(1);
+    }
+    std::cout << "Heatmap of texture " << i << " (" << heatmap->GetCellSize()
+              << " texel cells): " << filename << std::endl;
+    heatmap->Clear();
+  }
+}
+
+// Runs every access pattern on cores with private L1s sharing an L2.
+static void RunMultiCore(const Scene &scene, const CacheConfig &l1, const CacheConfig &l2,
+                         int num_cores, int tile_size, int num_threads,
+                         const PatternOptions &patterns) {
+  MultiCore cores(l1, l2, num_cores, tile_size, num_threads);
+  const size_t num_pixels = static_cast<size_t>(scene.GetWidth()) * scene.GetHeight();
+
+  std::vector<std::string> run_names;
+  std::vector<std::vector<OwnerStats> > overfetch;
+  for (int i = 0; i < kNumAccessPatterns; ++i) {
+    EAccessPattern pattern = static_cast<EAccessPattern>(i);
+    std::unique_ptr<AccessPattern> ap = AccessPattern::Create(pattern, patterns);
+    cores.Run(scene, *ap);
+
+    const CacheStats total = cores.GetL1Stats();
+    double min_hit_rate = 1.0, max_hit_rate = 0.0;
+    for (size_t c = 0; c < cores.GetNumCores(); ++c) {
+      const double hit_rate = cores.GetL1(c).GetStats().GetHitRate();
+      min_hit_rate = std::min(min_hit_rate, hit_rate);
+      max_hit_rate = std::max(max_hit_rate, hit_rate);
+    }
+
+    std::cout << "Cache stats for " << AccessPattern::GetName(pattern)
+              << " access pattern on " << num_cores << " cores: " << std::endl;
+    std::cout << "L1 hits: " << total.num_hits << std::endl;
+    std::cout << "L1 misses: " << total.num_misses << std::endl;
+    std::cout << "L1 accesses: " << total.num_accesses << std::endl;
+    std::cout << "L1 hit rate per core: " << min_hit_rate << " to " << max_hit_rate << std::endl;
+    std::cout << "L1 bytes filled from L2: " << total.bytes_filled << std::endl;
+    std::cout << "Shared L2:" << std::endl;
+    cores.GetL2().PrintStats();
+    PrintTrafficStats(scene, cores.GetL2(), num_pixels);
+    run_names.push_back(AccessPattern::GetName(pattern));
+    overfetch.push_back(cores.GetL2().GetOwnerStats());
+    if (Profiler::IsEnabled()) {
+      Profiler::Report(std::cout);
+      Profiler::Reset();
+    }
+    std::cout << std::endl;
+  }
+
+  PrintOverfetchTable(scene, run_names, overfetch);
+}
+
+// Simulates every combination of the swept cache sizes and line sizes,
+// generating the address stream of each run once.
+static void RunSweep(const Scene &scene, const Trace *trace, const CacheConfig &base,
+                     bool sector_size_set, const std::vector<size_t> &sizes_in_kb,
+                     const std::vector<size_t> &line_sizes, int num_threads,
+                     const PatternOptions &patterns, const WavefrontOptions &wavefronts) {
+  std::vector<CacheConfig> configs;
+  for (size_t kb : sizes_in_kb.empty() ? std::vector<size_t>(1, base.size_in_kb) : sizes_in_kb) {
+    for (size_t line : line_sizes.empty() ? std::vector<size_t>(1, base.line_size) : line_sizes) {
+      CacheConfig config = base;
+      config.size_in_kb = kb;
+      config.line_size = line;
+      if (!sector_size_set) {
+        config.sector_size = line;
+      }
+
+      if (!config.IsValid()) {
+        std::cerr << "Invalid swept cache configuration: " << kb << " KB with "
+                  << line << " byte lines." << std::endl;
+        exit(1);
+      }
+      configs.push_back(config);
+    }
+  }
+
+  std::vector<std::string> run_names;
+  std::vector<std::function<void(Cache *)> > runs;
+  if (nullptr != trace) {
+    run_names.push_back("trace");
+    runs.push_back([&scene, trace](Cache *c) { trace->Run(scene, c); });
+  } else {
+    for (int i = 0; i < kNumAccessPatterns; ++i) {
+      EAccessPattern pattern = static_cast<EAccessPattern>(i);
+      std::shared_ptr<AccessPattern> ap(AccessPattern::Create(pattern, patterns));
+      run_names.push_back(std::string(AccessPattern::GetName(pattern)) + " access pattern");
+      runs.push_back([&scene, ap, &wavefronts](Cache *c) { ap->Run(scene, c, wavefronts); });
+    }
+  }
+
+  Sweep sweep(configs, num_threads);
+  for (size_t r = 0; r < runs.size(); ++r) {
+    sweep.Run(runs[r]);
+
+    std::cout << "Sweep results for " << run_names[r] << ":" << std::endl;
+    std::cout << std::setw(10) << "cache KB" << std::setw(10) << "line"
+              << std::setw(12) << "hits" << std::setw(12) << "misses"
+              << std::setw(10) << "hit rate" << std::setw(16) << "bytes filled" << std::endl;
+    for (size_t i = 0; i < sweep.GetNumCaches(); ++i) {
+      const CacheConfig &config = sweep.GetCache(i).GetConfig();
+      const CacheStats stats = sweep.GetCache(i).GetStats();
+      std::cout << std::setw(10) << config.size_in_kb << std::setw(10) << config.line_size
+                << std::setw(12) << stats.num_hits << std::setw(12) << stats.num_misses
+                << std::setw(10) << std::fixed << std::setprecision(4)
+                << stats.GetHitRate()
+                << std::setw(16) << stats.bytes_filled << std::endl;
+      std::cout.unsetf(std::ios::floatfield);
+      std::cout << std::setprecision(6);
+    }
+    if (Profiler::IsEnabled()) {
+      Profiler::Report(std::cout);
+      Profiler::Reset();
+    }
+    std::cout << std::endl;
+  }
+}
+
+int main(int argc, char **argv) {
+  // Options come before the textures...
+  CacheConfig config;
+  LayoutOptions layout;
+  EBlockOrder block_order = eBlockOrder_Raster;
+  const char *training_filename = nullptr;
+  std::vector<size_t> sweep_kb, sweep_line_sizes;
+  size_t num_threads = std::max(1u, std::thread::hardware_concurrency());
+  PatternOptions patterns;
+  CacheConfig l2_config(64);
+  l2_config.num_ways = 16;
+  size_t num_cores = 1, core_tile_size = 16;
+  size_t num_shards = 1;
+  const char *heatmap_prefix = nullptr;
+  size_t heatmap_cell_size = 0;
+  bool block_type_stats = false;
+  WavefrontOptions wavefronts;
+  size_t num_hot_spots = static_cast<size_t>(patterns.num_hot_spots);
+  bool sector_size_set = false;
+  int arg = 1;
+  while (arg < argc && strncmp(argv[arg], "--", 2) == 0) {
+    if (strcmp(argv[arg], "--profile") == 0) {
+      Profiler::Enable();
+    } else if (strcmp(argv[arg], "--block-type-stats") == 0) {
+      block_type_stats = true;
+    } else if (ParseSizeOption(argv[arg], "--cache-kb", &config.size_in_kb) ||
+               ParseSizeOption(argv[arg], "--line-size", &config.line_size) ||
+               ParseSizeOption(argv[arg], "--ways", &config.num_ways) ||
+               ParseSizeOption(argv[arg], "--victim-entries", &config.victim_entries) ||
+               ParseSizeOption(argv[arg], "--block-buffer", &config.block_buffer_entries) ||
+               ParseSizeOption(argv[arg], "--decoded-texels", &config.decoded_cache_texels) ||
+               ParseSizeOption(argv[arg], "--banks", &config.num_banks) ||
+               ParseSizeOption(argv[arg], "--samples-per-cycle", &config.samples_per_cycle) ||
+               ParseSizeOption(argv[arg], "--threads", &num_threads) ||
+               ParseUnsignedOption(argv[arg], "--seed", &patterns.seed) ||
+               ParseSizeOption(argv[arg], "--hot-spots", &num_hot_spots) ||
+               ParseRealOption(argv[arg], "--walk-step", &patterns.walk_step) ||
+               ParseRealOption(argv[arg], "--jitter", &patterns.jitter) ||
+               ParseRealOption(argv[arg], "--hot-spot-radius", &patterns.hot_spot_radius) ||
+               ParseRealOption(argv[arg], "--hot-spot-weight", &patterns.hot_spot_weight) ||
+               ParseStepDistributionOption(argv[arg], &patterns.walk_distribution) ||
+               ParseSizeOption(argv[arg], "--wavefronts", &wavefronts.num_wavefronts) ||
+               ParseSizeOption(argv[arg], "--wavefront-samples", &wavefronts.samples_per_wavefront) ||
+               ParseSizeOption(argv[arg], "--interleave", &wavefronts.interleave) ||
+               ParseScheduleOption(argv[arg], &wavefronts.schedule) ||
+               ParseSizeOption(argv[arg], "--cores", &num_cores) ||
+               ParseSizeOption(argv[arg], "--shards", &num_shards) ||
+               ParseSizeOption(argv[arg], "--heatmap-cell", &heatmap_cell_size) ||
+               ParseSizeOption(argv[arg], "--core-tile", &core_tile_size) ||
+               ParseSizeOption(argv[arg], "--l2-kb", &l2_config.size_in_kb) ||
+               ParseSizeOption(argv[arg], "--l2-ways", &l2_config.num_ways) ||
+               ParseSizeListOption(argv[arg], "--sweep-kb", &sweep_kb) ||
+               ParseSizeListOption(argv[arg], "--sweep-line-size", &sweep_line_sizes)) {
+      // Parsed...
+    } else if (strcmp(argv[arg], "--bank-hash=modulo") == 0) {
+      config.bank_hash = eBankHash_Modulo;
+    } else if (strcmp(argv[arg], "--bank-hash=xor") == 0) {
+      config.bank_hash = eBankHash_Xor;
+    } else if (ParsePackingOption(argv[arg], &layout.packing) ||
+               ParseBlockOrderOption(argv[arg], &block_order) ||
+               ParseMetadataOption(argv[arg], &layout.metadata)) {
+      // Parsed...
+    } else if (strncmp(argv[arg], "--training-trace=", 17) == 0) {
+      training_filename = argv[arg] + 17;
+    } else if (strncmp(argv[arg], "--heatmap=", 10) == 0 && argv[arg][10] != '\0') {
+      heatmap_prefix = argv[arg] + 10;
+    } else if (ParseSizeOption(argv[arg], "--sector-size", &config.sector_size)) {
+      sector_size_set = true;
+    } else {
+      PrintUsageAndExit();
+    }
+    arg++;
+  }
+
+  if (!sector_size_set) {
+    config.sector_size = config.line_size;
+  }
+
+  patterns.num_hot_spots = static_cast<int>(num_hot_spots);
+  // The L2 takes the L1's line size...
+  l2_config.line_size = config.line_size;
+  l2_config.sector_size = config.line_size;
+  if (num_cores > 1 && !l2_config.IsValid()) {
+    std::cerr << "Invalid L2 configuration: it needs at least one line and a whole number of sets." << std::endl;
+    exit(1);
+  }
+
+  if (num_cores > 1 && (wavefronts.num_wavefronts > 1 || !sweep_kb.empty() ||
+                        !sweep_line_sizes.empty())) {
+    std::cerr << "Multiple cores cannot be combined with wavefronts or sweeps." << std::endl;
+    exit(1);
+  }
+
+  if ((nullptr != heatmap_prefix || block_type_stats) &&
+      (num_shards > 1 || num_cores > 1 || !sweep_kb.empty() || !sweep_line_sizes.empty())) {
+    std::cerr << "Heatmaps and block type stats follow the hits of one cache and cannot be "
+              << "combined with shards, multiple cores or sweeps." << std::endl;
+    exit(1);
+  }
+
+  if (num_shards > 1 && !ShardedSimulation::CanShard(config)) {
+    std::cerr << "Sharding needs a set-associative cache without a victim cache, block buffer, "
+              << "decoded block cache or banks." << std::endl;
+    exit(1);
+  }
+
+  if (num_shards > 1 && (num_cores > 1 || !sweep_kb.empty() || !sweep_line_sizes.empty())) {
+    std::cerr << "Sharding cannot be combined with multiple cores or sweeps." << std::endl;
+    exit(1);
+  }
+
+  if (eWavefrontSchedule_GreedyThenOldest == wavefronts.schedule &&
+      (num_shards > 1 || !sweep_kb.empty() || !sweep_line_sizes.empty())) {
+    std::cerr << "Greedy-then-oldest scheduling follows the misses of one cache and cannot be "
+              << "swept or sharded." << std::endl;
+    exit(1);
+  }
+
+  if (patterns.hot_spot_weight > 1.0) {
+    std::cerr << "The hot spot weight is a probability and must be at most 1." << std::endl;
+    exit(1);
+  }
+
+  if (!config.IsValid()) {
+    std::cerr << "Invalid cache configuration: line and sector sizes must be powers of two, "
+              << "with at most " << CacheConfig::kMaxSectorsPerLine
+              << " sectors per line, at least one line in the cache and a whole number of sets; "
+              << "xor bank hashing needs a power-of-two number of banks." << std::endl;
+    exit(1);
+  }
+
+  if (arg == argc) { PrintUsageAndExit(); }
+
+  if ((eBlockOrder_FirstTouch == block_order) != (nullptr != training_filename)) {
+    std::cerr << "First-touch block order needs a training trace, and only it uses one." << std::endl;
+    exit(1);
+  }
+
+  // Adaptive textures pack their blocks for the simulated line size...
+  layout.line_size = config.line_size;
+
+  // Every texture goes into the scene; a single texture is just a scene
+  // with one entry.
+  Scene scene;
+  std::unique_ptr<Trace> trace = nullptr;
+  const bool is_scene = strcmp(argv[arg], "scene") == 0;
+  if (is_scene) {
+    arg++;
+    if (arg == argc) { PrintUsageAndExit(); }
+  } else if (strcmp(argv[arg], "trace") == 0) {
+    if (arg + 2 >= argc) { PrintUsageAndExit(); }
+    trace = Trace::Open(argv[arg + 1]);
+    if (nullptr == trace) { exit(1); }
+    arg += 2;
+  }
+
+  std::vector<std::unique_ptr<Texture> > textures;
+  while (arg < argc) {
+    std::unique_ptr<Texture> tex = ParseTexture(argc, argv, &arg, layout);
+    if (nullptr == tex) { PrintUsageAndExit(); }
+    textures.push_back(std::move(tex));
+  }
+
+  if (textures.size() > 1 && !is_scene && nullptr == trace) {
+    PrintUsageAndExit();
+  }
+
+  const WavefrontOptions kSequential;
+  if (nullptr != trace && (wavefronts.num_wavefronts != kSequential.num_wavefronts ||
+                           wavefronts.samples_per_wavefront != kSequential.samples_per_wavefront ||
+                           wavefronts.interleave != kSequential.interleave ||
+                           wavefronts.schedule != kSequential.schedule)) {
+    std::cerr << "Wavefronts run the synthetic access patterns, not traces." << std::endl;
+    exit(1);
+  }
+
+  // Reorder the stored blocks before the textures are placed, since that
+  // can change their sizes...
+  if (eBlockOrder_Raster != block_order) {
+    std::vector<std::vector<int> > first_touches(textures.size());
+    if (nullptr != training_filename) {
+      std::unique_ptr<Trace> training = Trace::Open(training_filename);
+      if (nullptr == training) { exit(1); }
+      first_touches = training->GetFirstTouches(textures);
+    }
+
+    for (size_t i = 0; i < textures.size(); ++i) {
+      textures[i]->ReorderBlocks(block_order, first_touches[i]);
+    }
+  }
+
+  for (std::unique_ptr<Texture> &tex : textures) {
+    scene.AddTexture(std::move(tex));
+  }
+
+  std::cout << "Block order: " << GetBlockOrderName(block_order) << std::endl;
+  if (nullptr == trace) {
+    std::cout << "Stochastic patterns: walk step " << patterns.walk_step << " ("
+              << GetStepDistributionName(patterns.walk_distribution) << "), jitter "
+              << patterns.jitter << ", " << patterns.num_hot_spots << " hot spots of radius "
+              << patterns.hot_spot_radius << " with weight " << patterns.hot_spot_weight
+              << ", seed " << patterns.seed << std::endl;
+    if (wavefronts.num_wavefronts > 1) {
+      std::cout << "Wavefronts: " << wavefronts.num_wavefronts << " of "
+                << wavefronts.samples_per_wavefront << " samples, issuing "
+                << wavefronts.interleave << " per turn, "
+                << GetWavefrontScheduleName(wavefronts.schedule) << std::endl;
+    }
+  }
+  PrintLayoutStats(scene, layout);
+
+  if (Profiler::IsEnabled()) {
+    Profiler::Report(std::cout);
+    std::cout << std::endl;
+    Profiler::Reset();
+  }
+
+  if (!sweep_kb.empty() || !sweep_line_sizes.empty()) {
+    RunSweep(scene, trace.get(), config, sector_size_set, sweep_kb, sweep_line_sizes,
+             static_cast<int>(num_threads), patterns, wavefronts);
+    return 1;
+  }
+
+  Cache c(config);
+
+  // Sharded runs simulate the sets of c on several threads...
+  std::unique_ptr<ShardedSimulation> sharded =
+    (num_shards > 1) ? std::unique_ptr<ShardedSimulation>(
+      new ShardedSimulation(config, static_cast<int>(num_shards))) : nullptr;
+  auto simulate = [&sharded, &c](const std::function<void(Cache *)> &generate) {
+    if (nullptr != sharded) {
+      sharded->Run(generate, &c);
+    } else {
+      generate(&c);
+    }
+  };
+
+  // Give every texture a heatmap to record its hits and misses in...
+  std::vector<std::unique_ptr<Heatmap> > heatmaps;
+  if (nullptr != heatmap_prefix) {
+    for (size_t i = 0; i < scene.GetNumTextures(); ++i) {
+      Texture *tex = scene.GetTexture(i).get();
+      const int cell_size = (heatmap_cell_size > 0) ? static_cast<int>(heatmap_cell_size)
+                                                    : GetTextureBlockSize(tex->GetType());
+      heatmaps.push_back(std::unique_ptr<Heatmap>(
+        new Heatmap(tex->GetWidth(), tex->GetHeight(), cell_size)));
+      tex->SetHeatmap(heatmaps.back().get());
+    }
+  }
+
+  // ...and the adaptive ones block type stats.
+  std::vector<std::unique_ptr<BlockTypeStats> > type_stats;
+  if (block_type_stats) {
+    for (size_t i = 0; i < scene.GetNumTextures(); ++i) {
+      Texture *tex = scene.GetTexture(i).get();
+      const std::vector<std::string> names = tex->GetBlockTypeNames();
+      if (!names.empty()) {
+        type_stats.push_back(std::unique_ptr<BlockTypeStats>(new BlockTypeStats(names)));
+        tex->SetBlockTypeStats(type_stats.back().get());
+      }
+    }
+  }
+
+  if (num_cores > 1 && nullptr != trace) {
+    std::cerr << "Multiple cores run the synthetic access patterns, not traces." << std::endl;
+    exit(1);
+  }
+
+  // Captured traces replace the synthetic access patterns...
+  if (nullptr != trace) {
+    TraceStats stats = TraceStats();
+    simulate([&](Cache *sim) { stats = trace->Run(scene, sim); });
+    std::cout << "Cache stats for trace: " << std::endl;
+    std::cout << "Num trace records: " << stats.num_records << std::endl;
+    std::cout << "Num records skipped: " << stats.num_skipped << std::endl;
+    std::cout << "Num records clamped to top mip level: " << stats.num_lod_clamped << std::endl;
+    c.PrintStats();
+    PrintTrafficStats(scene, c, stats.num_samples);
+    PrintBlockTypeStats(scene, c);
+    if (nullptr != heatmap_prefix) {
+      WriteHeatmaps(scene, heatmap_prefix, "trace");
+    }
+    Profiler::Report(std::cout);
+    std::cout << std::endl;
+    PrintOverfetchTable(scene, std::vector<std::string>(1, "trace"),
+                        std::vector<std::vector<OwnerStats> >(1, c.GetOwnerStats()));
+    return 1;
+  }
+
+  if (num_cores > 1) {
+    RunMultiCore(scene, config, l2_config, static_cast<int>(num_cores),
+                 static_cast<int>(core_tile_size), static_cast<int>(num_threads), patterns);
+    return 1;
+  }
+
+  // Run each of the access patterns...
+  std::vector<std::string> run_names;
+  std::vector<std::vector<OwnerStats> > overfetch;
+  for (int i = 0; i < kNumAccessPatterns; ++i) {
+    EAccessPattern pattern = static_cast<EAccessPattern>(i);
+    std::unique_ptr<AccessPattern> ap = AccessPattern::Create(pattern, patterns);
+    simulate([&](Cache *sim) { ap->Run(scene, sim, wavefronts); });
+    std::cout << "Cache stats for " << AccessPattern::GetName(pattern)
+              << " access pattern: " << std::endl;
+    c.PrintStats();
+    PrintTrafficStats(scene, c, static_cast<size_t>(scene.GetWidth()) * scene.GetHeight());
+    PrintBlockTypeStats(scene, c);
+    if (nullptr != heatmap_prefix) {
+      WriteHeatmaps(scene, heatmap_prefix, AccessPattern::GetName(pattern));
+    }
+    run_names.push_back(AccessPattern::GetName(pattern));
+    overfetch.push_back(c.GetOwnerStats());
+    if (Profiler::IsEnabled()) {
+      Profiler::Report(std::cout);
+      Profiler::Reset();
+    }
+    std::cout << std::endl;
+    c.Clear();
+  }
+
+  PrintOverfetchTable(scene, run_names, overfetch);
 
   return 1;
 }
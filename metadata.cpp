@@ -0,0 +1,188 @@
+#include "metadata.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "cache.h"
+
+// Number of bits needed to store values in [0, max_value].
+static int BitsFor(int max_value) {
+  int bits = 0;
+  while (max_value >> bits) {
+    bits++;
+  }
+  return bits;
+}
+
+const char *GetMetadataEncodingName(EMetadataEncoding encoding) {
+  switch (encoding) {
+    case eMetadataEncoding_Flat: return "flat";
+    case eMetadataEncoding_BitPacked: return "bit-packed";
+    case eMetadataEncoding_DeltaTile: return "delta-tile";
+    case eMetadataEncoding_Hierarchical: return "hierarchical";
+    case kNumMetadataEncodings: break;
+  }
+  assert(false);
+  return "";
+}
+
+MetadataEncoding::Request MetadataEncoding::BitRange(size_t bit, int num_bits) {
+  Request r;
+  r.offset = static_cast<uint32_t>(bit / 8);
+  r.num_bytes = static_cast<uint32_t>((bit + num_bits - 1) / 8 - bit / 8 + 1);
+  return r;
+}
+
+void MetadataEncoding::Build(EMetadataEncoding encoding, int num_blocks_x, int num_blocks_y,
+                             int num_types, const std::vector<int> &types,
+                             const std::vector<int> &offsets) {
+  const size_t num_blocks = static_cast<size_t>(num_blocks_x) * num_blocks_y;
+  assert(types.size() == num_blocks && offsets.size() == num_blocks);
+
+  const Request kNoRequest = { 0, 0 };
+  _requests.assign(2 * num_blocks, kNoRequest);
+  _num_dependent_fetches = num_blocks;
+
+  // Flat entries are whole bytes and need no decoding...
+  _num_decode_ops = 0;
+
+  const int type_bits = BitsFor(num_types - 1);
+  const int max_offset = num_blocks > 0 ? *std::max_element(offsets.begin(), offsets.end()) : 0;
+
+  if (eMetadataEncoding_Flat == encoding) {
+    for (size_t i = 0; i < num_blocks; ++i) {
+      _requests[2 * i].offset = static_cast<uint32_t>(3 * i);
+      _requests[2 * i].num_bytes = 3;
+    }
+    _size = 3 * num_blocks;
+    return;
+  }
+
+  if (eMetadataEncoding_BitPacked == encoding) {
+    const int offset_bits = BitsFor(max_offset);
+    const int entry_bits = std::max(1, type_bits + offset_bits);
+    for (size_t i = 0; i < num_blocks; ++i) {
+      _requests[2 * i] = BitRange(i * entry_bits, entry_bits);
+    }
+    _num_decode_ops = num_blocks * (FieldOps(type_bits) + FieldOps(offset_bits));
+    _size = (num_blocks * entry_bits + 7) / 8;
+    return;
+  }
+
+  // Both tiled encodings store offsets relative to the smallest offset in
+  // the tile...
+  const int tiles_x = (num_blocks_x + kMetadataTileSize - 1) / kMetadataTileSize;
+  const int tiles_y = (num_blocks_y + kMetadataTileSize - 1) / kMetadataTileSize;
+  const size_t num_tiles = static_cast<size_t>(tiles_x) * tiles_y;
+  const int entries_per_tile = kMetadataTileSize * kMetadataTileSize;
+
+  std::vector<int> tile_base(num_tiles, max_offset);
+  std::vector<int> tile_max_delta(num_tiles, 0);
+  std::vector<bool> tile_one_type(num_tiles, true);
+  std::vector<int> tile_type(num_tiles, -1);
+  for (int pass = 0; pass < 2; ++pass) {
+    for (int y = 0; y < num_blocks_y; ++y) {
+      for (int x = 0; x < num_blocks_x; ++x) {
+        const size_t i = static_cast<size_t>(y) * num_blocks_x + x;
+        const size_t t = (y / kMetadataTileSize) * tiles_x + x / kMetadataTileSize;
+        if (0 == pass) {
+          tile_base[t] = std::min(tile_base[t], offsets[i]);
+          tile_one_type[t] = tile_one_type[t] && (tile_type[t] < 0 || tile_type[t] == types[i]);
+          tile_type[t] = types[i];
+        } else {
+          tile_max_delta[t] = std::max(tile_max_delta[t], offsets[i] - tile_base[t]);
+        }
+      }
+    }
+  }
+
+  // Per tile entry width, the byte address of its packed entries and the
+  // operations to decode one of them: the type and delta fields, and an
+  // add to apply the base when there is a delta.
+  std::vector<int> entry_bits(num_tiles);
+  std::vector<size_t> entries_address(num_tiles);
+  std::vector<int> decode_ops(num_tiles);
+  if (eMetadataEncoding_DeltaTile == encoding) {
+    const int delta_bits = BitsFor(*std::max_element(tile_max_delta.begin(), tile_max_delta.end()));
+    const int bits = std::max(1, type_bits + delta_bits);
+    const size_t record_size = 4 + (entries_per_tile * bits + 7) / 8;
+    for (size_t t = 0; t < num_tiles; ++t) {
+      entry_bits[t] = bits;
+      entries_address[t] = t * record_size + 4;
+      decode_ops[t] = FieldOps(type_bits) + FieldOps(delta_bits) + (delta_bits > 0 ? 1 : 0);
+    }
+    _size = num_tiles * record_size;
+  } else {
+    assert(eMetadataEncoding_Hierarchical == encoding);
+    _size = 8 * num_tiles;
+    for (size_t t = 0; t < num_tiles; ++t) {
+      const int delta_bits = BitsFor(tile_max_delta[t]);
+      entry_bits[t] = (tile_one_type[t] ? 0 : type_bits) + delta_bits;
+      entries_address[t] = _size;
+      _size += (entries_per_tile * entry_bits[t] + 7) / 8;
+
+      // The type comes from the tile entry or the second level. Reading
+      // the second level first takes unpacking the tile's two field
+      // widths...
+      decode_ops[t] = FieldOps(type_bits);
+      if (entry_bits[t] > 0) {
+        decode_ops[t] += 2 * FieldOps(1) + FieldOps(delta_bits) + (delta_bits > 0 ? 1 : 0);
+      }
+    }
+  }
+
+  for (int y = 0; y < num_blocks_y; ++y) {
+    for (int x = 0; x < num_blocks_x; ++x) {
+      const size_t i = static_cast<size_t>(y) * num_blocks_x + x;
+      const size_t t = (y / kMetadataTileSize) * tiles_x + x / kMetadataTileSize;
+      const int local = (y % kMetadataTileSize) * kMetadataTileSize + x % kMetadataTileSize;
+      _num_decode_ops += decode_ops[t];
+
+      Request &tile_request = _requests[2 * i];
+      if (eMetadataEncoding_DeltaTile == encoding) {
+        tile_request.offset = static_cast<uint32_t>(entries_address[t] - 4);
+        tile_request.num_bytes = 4;
+      } else {
+        tile_request.offset = static_cast<uint32_t>(8 * t);
+        tile_request.num_bytes = 8;
+      }
+
+      if (entry_bits[t] > 0) {
+        _requests[2 * i + 1] = BitRange(8 * entries_address[t] + local * entry_bits[t],
+                                        entry_bits[t]);
+
+        // The second level can only be found after reading the first...
+        if (eMetadataEncoding_Hierarchical == encoding) {
+          _num_dependent_fetches++;
+        }
+      }
+    }
+  }
+}
+
+void MetadataEncoding::Access(size_t base_address, int block_idx, Cache *c) const {
+  const Request *r = &_requests[2 * static_cast<size_t>(block_idx)];
+  c->Access(base_address + r[0].offset, r[0].num_bytes);
+  if (r[1].num_bytes > 0) {
+    c->Access(base_address + r[1].offset, r[1].num_bytes);
+  }
+}
+
+void MetadataEncoding::AppendRequests(size_t base_address, int block_idx,
+                                      std::vector<CacheRequest> *requests) const {
+  const Request *r = &_requests[2 * static_cast<size_t>(block_idx)];
+  for (int i = 0; i < 2 && r[i].num_bytes > 0; ++i) {
+    CacheRequest request = { base_address + r[i].offset, r[i].num_bytes, 0, 0 };
+    requests->push_back(request);
+  }
+}
+
+double MetadataEncoding::GetFetchesPerLookup() const {
+  const size_t num_blocks = _requests.size() / 2;
+  return num_blocks > 0 ? static_cast<double>(_num_dependent_fetches) / num_blocks : 0.0;
+}
+
+double MetadataEncoding::GetDecodeOpsPerLookup() const {
+  const size_t num_blocks = _requests.size() / 2;
+  return num_blocks > 0 ? static_cast<double>(_num_decode_ops) / num_blocks : 0.0;
+}
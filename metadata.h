@@ -0,0 +1,88 @@
+#ifndef __METADATA_H__
+#define __METADATA_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Forward declare...
+class Cache;
+struct CacheRequest;
+
+// How an adaptive texture stores the type and offset of each block. Tiles
+// are kMetadataTileSize x kMetadataTileSize blocks.
+enum EMetadataEncoding {
+  // Three bytes per block.
+  eMetadataEncoding_Flat,
+
+  // Type and offset bit-packed per block, each field just wide enough
+  // for the largest value in the texture.
+  eMetadataEncoding_BitPacked,
+
+  // A 4-byte base offset per tile followed by bit-packed types and
+  // offsets relative to the base.
+  eMetadataEncoding_DeltaTile,
+
+  // An 8-byte entry per tile holding the base offset and the field widths
+  // of the tile, pointing to a second level of bit-packed entries. Tiles
+  // whose blocks all share one type and offset have no second level.
+  eMetadataEncoding_Hierarchical,
+
+  kNumMetadataEncodings
+};
+
+static const int kMetadataTileSize = 4;
+
+const char *GetMetadataEncodingName(EMetadataEncoding encoding);
+
+// The metadata of one adaptive texture laid out in a given encoding. Each
+// lookup is modelled as up to two cache requests, the second of which may
+// depend on the first.
+class MetadataEncoding {
+ public:
+  MetadataEncoding() : _size(0), _num_dependent_fetches(0), _num_decode_ops(0) { }
+
+  // types and offsets hold the fields of each block of the grid in
+  // raster order. num_types is the number of distinct block types.
+  void Build(EMetadataEncoding encoding, int num_blocks_x, int num_blocks_y, int num_types,
+             const std::vector<int> &types, const std::vector<int> &offsets);
+
+  // Sends the requests that look up block_idx to the cache.
+  void Access(size_t base_address, int block_idx, Cache *c) const;
+
+  // Appends the same requests to a batch.
+  void AppendRequests(size_t base_address, int block_idx,
+                      std::vector<CacheRequest> *requests) const;
+
+  size_t GetSizeInBytes() const { return _size; }
+
+  // Average number of serialized memory round trips per lookup, assuming
+  // every block is looked up equally often.
+  double GetFetchesPerLookup() const;
+
+  // Average modelled ALU operations to extract the type and offset from
+  // the fetched bits, assuming every block is looked up equally often.
+  double GetDecodeOpsPerLookup() const;
+
+ private:
+  struct Request {
+    uint32_t offset;
+    uint32_t num_bytes;
+  };
+
+  // Request for bits [bit, bit + num_bits) of the metadata.
+  static Request BitRange(size_t bit, int num_bits);
+
+  // Operations to extract a bit-packed field: a shift and a mask, unless
+  // the field is empty.
+  static int FieldOps(int num_bits) { return num_bits > 0 ? 2 : 0; }
+
+  size_t _size;
+  size_t _num_dependent_fetches;
+  size_t _num_decode_ops;
+
+  // Two requests per block; unused ones have zero bytes.
+  std::vector<Request> _requests;
+};
+
+#endif  // __METADATA_H__
@@ -0,0 +1,112 @@
+#include "multicore.h"
+
+#include <algorithm>
+#include <cassert>
+#include <thread>
+
+#include "access_pattern.h"
+#include "profiler.h"
+#include "scene.h"
+
+MultiCore::MultiCore(const CacheConfig &l1, const CacheConfig &l2, int num_cores, int tile_size,
+                     int num_threads)
+  : _tile_size(tile_size)
+  , _num_threads(std::max(1, std::min(num_cores, num_threads)))
+  , _l2(l2) {
+  assert(num_cores > 0 && tile_size > 0);
+  for (int i = 0; i < num_cores; ++i) {
+    _l1s.push_back(std::unique_ptr<Cache>(new Cache(l1)));
+  }
+}
+
+void MultiCore::Run(const Scene &scene, const AccessPattern &pattern) {
+  const int w = scene.GetWidth();
+  const int h = scene.GetHeight();
+  const size_t num_cores = _l1s.size();
+
+  // Deal the samples out to the cores by screen tile...
+  std::vector<std::vector<std::pair<int, int> > > core_samples(num_cores);
+  {
+    ScopedPhase phase(eProfilePhase_Generate);
+    const std::vector<std::pair<int, int> > samples = pattern.GenerateSamples(w, h);
+    const int tiles_x = (w + _tile_size - 1) / _tile_size;
+    for (const std::pair<int, int> &sample : samples) {
+      const size_t tile =
+        static_cast<size_t>(sample.second / _tile_size) * tiles_x + sample.first / _tile_size;
+      core_samples[tile % num_cores].push_back(sample);
+    }
+  }
+
+  ScopedPhase phase(eProfilePhase_Simulate);
+
+  // Each core's fills, and where the fills of each of its samples end.
+  std::vector<std::vector<CacheRequest> > fills(num_cores);
+  std::vector<std::vector<size_t> > sample_ends(num_cores);
+  auto simulate = [&](size_t first_core) {
+    for (size_t i = first_core; i < num_cores; i += _num_threads) {
+      Cache *l1 = _l1s[i].get();
+      l1->Clear();
+      l1->SetFillLog(&fills[i]);
+      sample_ends[i].reserve(core_samples[i].size());
+      for (const std::pair<int, int> &sample : core_samples[i]) {
+        AccessPattern::Sample(scene, sample, l1);
+        sample_ends[i].push_back(fills[i].size());
+      }
+      l1->SetFillLog(nullptr);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (int t = 1; t < _num_threads; ++t) {
+    workers.push_back(std::thread(simulate, static_cast<size_t>(t)));
+  }
+  simulate(0);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  // Merge the cores in lockstep into the shared L2...
+  _l2.Clear();
+  size_t num_steps = 0;
+  for (const std::vector<size_t> &ends : sample_ends) {
+    num_steps = std::max(num_steps, ends.size());
+  }
+  for (size_t step = 0; step < num_steps; ++step) {
+    for (size_t i = 0; i < num_cores; ++i) {
+      if (step >= sample_ends[i].size()) {
+        continue;
+      }
+
+      const size_t begin = (step > 0) ? sample_ends[i][step - 1] : 0;
+      for (size_t f = begin; f < sample_ends[i][step]; ++f) {
+        const CacheRequest &fill = fills[i][f];
+        _l2.SetOwner(fill.owner);
+        _l2.Access(fill.address, fill.num_bytes);
+      }
+    }
+    _l2.EndSample();
+  }
+}
+
+CacheStats MultiCore::GetL1Stats() const {
+  CacheStats total = CacheStats();
+  for (const std::unique_ptr<Cache> &l1 : _l1s) {
+    const CacheStats stats = l1->GetStats();
+    total.num_hits += stats.num_hits;
+    total.num_misses += stats.num_misses;
+    total.num_accesses += stats.num_accesses;
+    total.num_sector_misses += stats.num_sector_misses;
+    total.num_sectors_filled += stats.num_sectors_filled;
+    total.num_victim_hits += stats.num_victim_hits;
+    total.num_block_buffer_hits += stats.num_block_buffer_hits;
+    total.num_decoded_hits += stats.num_decoded_hits;
+    total.num_decodes += stats.num_decodes;
+    total.num_samples += stats.num_samples;
+    total.num_cycles += stats.num_cycles;
+    total.num_bank_stalls += stats.num_bank_stalls;
+    total.bytes_requested += stats.bytes_requested;
+    total.bytes_filled += stats.bytes_filled;
+    total.bytes_wasted += stats.bytes_wasted;
+  }
+  return total;
+}
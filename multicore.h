@@ -0,0 +1,45 @@
+#ifndef __MULTICORE_H__
+#define __MULTICORE_H__
+
+#include <memory>
+#include <vector>
+
+#include "cache.h"
+
+// Forward declare
+class AccessPattern;
+class Scene;
+
+// Shader cores with private L1s in front of one shared L2. The screen is
+// cut into square tiles dealt to the cores round-robin, and each core
+// takes the samples of the access pattern that fall in its tiles, in the
+// pattern's order.
+//
+// The L1s are simulated in parallel, each logging the fills it needs from
+// the L2. The L2 then sees the cores in lockstep: the fills of every
+// core's first sample in core order, then of every core's second sample
+// and so on. This order depends on nothing but the inputs, so results
+// are the same for any number of threads.
+class MultiCore {
+ public:
+  MultiCore(const CacheConfig &l1, const CacheConfig &l2, int num_cores, int tile_size,
+            int num_threads);
+
+  // Clears every cache and runs the pattern over the scene.
+  void Run(const Scene &scene, const AccessPattern &pattern);
+
+  size_t GetNumCores() const { return _l1s.size(); }
+  const Cache &GetL1(size_t core) const { return *_l1s[core]; }
+  const Cache &GetL2() const { return _l2; }
+
+  // Sum of the L1 stats of all cores.
+  CacheStats GetL1Stats() const;
+
+ private:
+  const int _tile_size;
+  const int _num_threads;
+  std::vector<std::unique_ptr<Cache> > _l1s;
+  Cache _l2;
+};
+
+#endif  // __MULTICORE_H__
@@ -0,0 +1,164 @@
+#include "profiler.h"
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+bool Profiler::_enabled = false;
+
+namespace {
+
+struct PhaseState {
+  PhaseStats stats;
+  std::chrono::steady_clock::time_point start_time;
+  uint64_t start_counters[kNumPerfCounters];
+};
+
+PhaseState gPhases[kNumProfilePhases];
+
+#ifdef __linux__
+int gCounterFds[kNumPerfCounters] = { -1, -1, -1, -1 };
+
+const uint64_t kCounterConfigs[kNumPerfCounters] = {
+  PERF_COUNT_HW_CPU_CYCLES,
+  PERF_COUNT_HW_INSTRUCTIONS,
+  PERF_COUNT_HW_CACHE_MISSES,
+  PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+bool OpenCounters() {
+  for (int i = 0; i < kNumPerfCounters; ++i) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = kCounterConfigs[i];
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    // Count the threads started from now on too, since sweeps, shards and
+    // multiple cores simulate on worker threads. Inherited counters can't
+    // be read as a group, so each counter is its own event.
+    attr.inherit = 1;
+    int fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+    if (fd < 0) {
+      for (int j = 0; j < i; ++j) {
+        close(gCounterFds[j]);
+        gCounterFds[j] = -1;
+      }
+      return false;
+    }
+    gCounterFds[i] = fd;
+  }
+
+  for (int i = 0; i < kNumPerfCounters; ++i) {
+    ioctl(gCounterFds[i], PERF_EVENT_IOC_RESET, 0);
+    ioctl(gCounterFds[i], PERF_EVENT_IOC_ENABLE, 0);
+  }
+  return true;
+}
+
+void ReadCounters(uint64_t *values) {
+  for (int i = 0; i < kNumPerfCounters; ++i) {
+    if (gCounterFds[i] < 0 || read(gCounterFds[i], &values[i], sizeof(uint64_t)) != sizeof(uint64_t)) {
+      values[i] = 0;
+    }
+  }
+}
+#else
+bool OpenCounters() { return false; }
+
+void ReadCounters(uint64_t *values) {
+  memset(values, 0, kNumPerfCounters * sizeof(uint64_t));
+}
+#endif
+
+bool gHasCounters = false;
+
+}  // namespace
+
+void Profiler::Enable() {
+  if (!_enabled) {
+    gHasCounters = OpenCounters();
+    if (!gHasCounters) {
+      std::cerr << "Hardware performance counters unavailable; reporting timers only." << std::endl;
+    }
+    Reset();
+  }
+  _enabled = true;
+}
+
+bool Profiler::HasCounters() {
+  return gHasCounters;
+}
+
+void Profiler::Begin(EProfilePhase phase) {
+  PhaseState &state = gPhases[phase];
+  ReadCounters(state.start_counters);
+  state.start_time = std::chrono::steady_clock::now();
+}
+
+void Profiler::End(EProfilePhase phase) {
+  PhaseState &state = gPhases[phase];
+  const std::chrono::steady_clock::time_point end_time = std::chrono::steady_clock::now();
+  uint64_t end_counters[kNumPerfCounters];
+  ReadCounters(end_counters);
+
+  state.stats.num_calls++;
+  state.stats.seconds += std::chrono::duration<double>(end_time - state.start_time).count();
+  for (int i = 0; i < kNumPerfCounters; ++i) {
+    state.stats.counters[i] += end_counters[i] - state.start_counters[i];
+  }
+}
+
+const PhaseStats &Profiler::GetStats(EProfilePhase phase) {
+  return gPhases[phase].stats;
+}
+
+const char *Profiler::GetName(EProfilePhase phase) {
+  switch (phase) {
+    case eProfilePhase_Layout: return "layout construction";
+    case eProfilePhase_Generate: return "pattern generation";
+    case eProfilePhase_Simulate: return "simulation";
+    default: break;
+  }
+  return "";
+}
+
+void Profiler::Report(std::ostream &os) {
+  for (int i = 0; i < kNumProfilePhases; ++i) {
+    const EProfilePhase phase = static_cast<EProfilePhase>(i);
+    const PhaseStats &stats = GetStats(phase);
+    if (0 == stats.num_calls) {
+      continue;
+    }
+
+    os << "Profile " << GetName(phase) << ": " << std::fixed << std::setprecision(3)
+       << stats.seconds * 1000.0 << " ms";
+    if (gHasCounters) {
+      const uint64_t cycles = stats.counters[ePerfCounter_Cycles];
+      const uint64_t instructions = stats.counters[ePerfCounter_Instructions];
+      os << ", " << cycles << " cycles"
+         << ", " << instructions << " instructions"
+         << " (IPC " << std::setprecision(2)
+         << (cycles ? static_cast<double>(instructions) / cycles : 0.0) << ")"
+         << ", " << stats.counters[ePerfCounter_LLCMisses] << " LLC misses"
+         << ", " << stats.counters[ePerfCounter_BranchMisses] << " branch misses";
+    }
+    os.unsetf(std::ios::floatfield);
+    os << std::setprecision(6) << std::endl;
+  }
+}
+
+void Profiler::Reset() {
+  for (int i = 0; i < kNumProfilePhases; ++i) {
+    memset(&gPhases[i].stats, 0, sizeof(PhaseStats));
+  }
+}
@@ -0,0 +1,83 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include <cstdint>
+#include <iostream>
+
+// Self-instrumentation of the simulator. When enabled, each phase is
+// timed and, on Linux, measured with hardware performance counters read
+// through perf_event_open. The counters cover every thread started after
+// Enable, so a phase's counts include what worker threads did while it
+// was open on the calling thread. When disabled a ScopedPhase is a single
+// branch on a global flag.
+
+enum EProfilePhase {
+  eProfilePhase_Layout,
+  eProfilePhase_Generate,
+  eProfilePhase_Simulate,
+
+  kNumProfilePhases
+};
+
+enum EPerfCounter {
+  ePerfCounter_Cycles,
+  ePerfCounter_Instructions,
+  ePerfCounter_LLCMisses,
+  ePerfCounter_BranchMisses,
+
+  kNumPerfCounters
+};
+
+struct PhaseStats {
+  size_t num_calls;
+  double seconds;
+  uint64_t counters[kNumPerfCounters];
+};
+
+class Profiler {
+ public:
+  // Opens the counters; threads started before this aren't counted.
+  // Timers still work if the counters can't be opened, e.g. because of
+  // perf_event_paranoid.
+  static void Enable();
+  static bool IsEnabled() { return _enabled; }
+  static bool HasCounters();
+
+  static void Begin(EProfilePhase phase);
+  static void End(EProfilePhase phase);
+
+  static const PhaseStats &GetStats(EProfilePhase phase);
+  static const char *GetName(EProfilePhase phase);
+
+  // Prints every phase that ran since the last Reset.
+  static void Report(std::ostream &os);
+  static void Reset();
+
+ private:
+  static bool _enabled;
+};
+
+class ScopedPhase {
+ public:
+  explicit ScopedPhase(EProfilePhase phase)
+    : _phase(phase), _active(Profiler::IsEnabled()) {
+    if (_active) {
+      Profiler::Begin(_phase);
+    }
+  }
+
+  ~ScopedPhase() {
+    if (_active) {
+      Profiler::End(_phase);
+    }
+  }
+
+ private:
+  ScopedPhase(const ScopedPhase &);
+  ScopedPhase &operator=(const ScopedPhase &);
+
+  const EProfilePhase _phase;
+  const bool _active;
+};
+
+#endif  // __PROFILER_H__
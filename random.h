@@ -0,0 +1,135 @@
+#ifndef __RANDOM_H__
+#define __RANDOM_H__
+
+#include <cmath>
+#include <cstdint>
+
+// Seeded random number generation that gives the same results on every
+// platform, unlike rand() whose sequence is up to the C library.
+
+// Expands one 64-bit seed into a stream of well mixed values, used to
+// seed the generators below.
+static inline uint64_t SplitMix64(uint64_t *state) {
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+// The xoshiro256** generator.
+class Xoshiro256 {
+ public:
+  explicit Xoshiro256(uint64_t seed) {
+    for (int i = 0; i < 4; ++i) {
+      _state[i] = SplitMix64(&seed);
+    }
+  }
+
+  uint64_t Next() {
+    const uint64_t result = Rotate(_state[1] * 5, 7) * 9;
+    const uint64_t t = _state[1] << 17;
+    _state[2] ^= _state[0];
+    _state[3] ^= _state[1];
+    _state[1] ^= _state[2];
+    _state[0] ^= _state[3];
+    _state[2] ^= t;
+    _state[3] = Rotate(_state[3], 45);
+    return result;
+  }
+
+ private:
+  static uint64_t Rotate(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+  }
+
+  uint64_t _state[4];
+};
+
+// A generator whose stream is keyed by a seed and a counter, so the
+// draws for any element of a sequence can be made without making the
+// draws for the elements before it.
+class CounterGenerator {
+ public:
+  CounterGenerator(uint64_t seed, uint64_t counter)
+    : _state(seed ^ (counter * 0xD1B54A32D192ED03ULL)) { }
+
+  uint64_t Next() { return SplitMix64(&_state); }
+
+ private:
+  uint64_t _state;
+};
+
+// Uniform in [0, 1).
+template<typename Generator>
+static inline double NextUniform(Generator *rng) {
+  return static_cast<double>(rng->Next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Standard normal, by the Box-Muller transform.
+template<typename Generator>
+static inline double NextGaussian(Generator *rng) {
+  const double kTwoPi = 6.283185307179586;
+  const double u = 1.0 - NextUniform(rng);
+  return std::sqrt(-2.0 * std::log(u)) * std::cos(kTwoPi * NextUniform(rng));
+}
+
+// Standard Cauchy, whose heavy tails make for occasional long jumps.
+template<typename Generator>
+static inline double NextCauchy(Generator *rng) {
+  const double kPi = 3.141592653589793;
+  return std::tan(kPi * (NextUniform(rng) - 0.5));
+}
+
+// A random permutation of [0, n) that maps indices one at a time without
+// storing or shuffling anything. Indices are scrambled by a keyed
+// bijection of the smallest power-of-two range holding n, and values that
+// land outside [0, n) are scrambled again until they fall inside
+// ("cycle walking"), which takes fewer than two rounds on average.
+class RandomPermutation {
+ public:
+  template<typename Generator>
+  RandomPermutation(uint64_t n, Generator *rng) : _n(n), _bits(0) {
+    while (_bits < 64 && (1ULL << _bits) < n) {
+      _bits++;
+    }
+    _mask = (_bits < 64) ? (1ULL << _bits) - 1 : ~0ULL;
+    _shift = (_bits + 1) / 2;
+    for (int i = 0; i < kNumRounds; ++i) {
+      _multipliers[i] = rng->Next() | 1;
+      _keys[i] = rng->Next();
+    }
+  }
+
+  uint64_t GetSize() const { return _n; }
+
+  uint64_t operator[](uint64_t i) const {
+    uint64_t x = i;
+    do {
+      x = Scramble(x);
+    } while (x >= _n);
+    return x;
+  }
+
+ private:
+  static const int kNumRounds = 3;
+
+  // Each step is invertible modulo 2^_bits: multiplying by an odd number,
+  // adding a key and xor-ing in the value's own high bits.
+  uint64_t Scramble(uint64_t x) const {
+    for (int i = 0; i < kNumRounds; ++i) {
+      x = (x * _multipliers[i]) & _mask;
+      x = (x + _keys[i]) & _mask;
+      x ^= x >> _shift;
+    }
+    return x;
+  }
+
+  uint64_t _n;
+  int _bits;
+  int _shift;
+  uint64_t _mask;
+  uint64_t _multipliers[kNumRounds];
+  uint64_t _keys[kNumRounds];
+};
+
+#endif  // __RANDOM_H__
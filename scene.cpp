@@ -0,0 +1,24 @@
+#include "scene.h"
+
+#include <algorithm>
+
+void Scene::AddTexture(std::unique_ptr<Texture> tex) {
+  tex->SetBaseAddress(_next_address);
+
+  size_t end_address = _next_address + tex->GetSizeInBytes();
+  _next_address =
+    ((end_address + kTextureAlignment - 1) / kTextureAlignment) * kTextureAlignment;
+
+  _w = std::max(_w, tex->GetWidth());
+  _h = std::max(_h, tex->GetHeight());
+  _textures.push_back(std::move(tex));
+}
+
+bool Scene::HasInstrumentedTextures() const {
+  for (const std::unique_ptr<Texture> &tex : _textures) {
+    if (tex->IsInstrumented()) {
+      return true;
+    }
+  }
+  return false;
+}
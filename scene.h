@@ -0,0 +1,46 @@
+#ifndef __SCENE_H__
+#define __SCENE_H__
+
+#include <memory>
+#include <vector>
+
+#include "texture.h"
+
+// Textures are placed on their own pages so that no two of them share a
+// cache line.
+static const size_t kTextureAlignment = 4096;
+
+// A set of textures sampled together, e.g. the albedo, normal, roughness
+// and AO maps of one material. Each texture is placed at a distinct base
+// address in a shared address space so that they compete for the same
+// cache.
+class Scene {
+ public:
+  Scene() : _next_address(0), _w(0), _h(0) { }
+
+  void AddTexture(std::unique_ptr<Texture> tex);
+
+  size_t GetNumTextures() const { return _textures.size(); }
+  const std::unique_ptr<Texture> &GetTexture(size_t idx) const {
+    return _textures[idx];
+  }
+
+  // The scene is sampled over a render target as large as its largest
+  // texture; smaller textures are sampled at scaled coordinates.
+  int GetWidth() const { return _w; }
+  int GetHeight() const { return _h; }
+
+  // True if any texture records its samples as they are simulated.
+  bool HasInstrumentedTextures() const;
+
+  // Total bytes spanned by the placed textures.
+  size_t GetSizeInBytes() const { return _next_address; }
+
+ private:
+  std::vector<std::unique_ptr<Texture> > _textures;
+  size_t _next_address;
+  int _w;
+  int _h;
+};
+
+#endif  // __SCENE_H__
@@ -0,0 +1,157 @@
+#include "shard.h"
+
+#include <algorithm>
+#include <cassert>
+#include <thread>
+
+#include "profiler.h"
+
+RequestQueue::RequestQueue(size_t capacity)
+  : _buffer(capacity)
+  , _mask(capacity - 1)
+  , _head(0)
+  , _cached_head(0)
+  , _tail(0)
+  , _cached_tail(0) {
+  assert(capacity > 0 && 0 == (capacity & _mask));
+}
+
+void RequestQueue::Push(const CacheRequest *requests, size_t num_requests) {
+  const size_t tail = _tail.load(std::memory_order_relaxed);
+  while (tail + num_requests - _cached_head > _buffer.size()) {
+    _cached_head = _head.load(std::memory_order_acquire);
+    if (tail + num_requests - _cached_head > _buffer.size()) {
+      std::this_thread::yield();
+    }
+  }
+
+  for (size_t i = 0; i < num_requests; ++i) {
+    _buffer[(tail + i) & _mask] = requests[i];
+  }
+  _tail.store(tail + num_requests, std::memory_order_release);
+}
+
+size_t RequestQueue::Peek(const CacheRequest **requests) {
+  const size_t head = _head.load(std::memory_order_relaxed);
+  if (head == _cached_tail) {
+    _cached_tail = _tail.load(std::memory_order_acquire);
+  }
+
+  *requests = &_buffer[head & _mask];
+  return std::min(_cached_tail - head, _buffer.size() - (head & _mask));
+}
+
+void RequestQueue::Pop(size_t num_requests) {
+  _head.store(_head.load(std::memory_order_relaxed) + num_requests, std::memory_order_release);
+}
+
+static int Log2(size_t x) {
+  int result = 0;
+  while ((static_cast<size_t>(1) << result) < x) {
+    result++;
+  }
+  return result;
+}
+
+ShardedSimulation::ShardedSimulation(const CacheConfig &config, int num_shards)
+  : _line_shift(Log2(config.line_size))
+  , _num_sets((config.size_in_kb * 1024 / config.line_size) / config.num_ways)
+  , _recorder(CacheConfig())
+  , _owner(0)
+  , _done(false) {
+  assert(CanShard(config) && num_shards > 0);
+  for (int i = 0; i < num_shards; ++i) {
+    _shards.push_back(std::unique_ptr<Cache>(new Cache(config)));
+    _queues.push_back(std::unique_ptr<RequestQueue>(new RequestQueue(kQueueSize)));
+    _pending.push_back(std::vector<CacheRequest>());
+    _pending.back().reserve(kBatchSize);
+  }
+  _recorder.SetSink(this);
+}
+
+void ShardedSimulation::Run(const std::function<void(Cache *)> &generate, Cache *result) {
+  _owner = 0;
+  _done.store(false);
+  for (size_t i = 0; i < _shards.size(); ++i) {
+    _shards[i]->Clear();
+    _queues[i]->Reset();
+    _pending[i].clear();
+  }
+
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < _shards.size(); ++i) {
+    workers.push_back(std::thread(&ShardedSimulation::WorkerLoop, this, i));
+  }
+
+  generate(&_recorder);
+
+  // The workers drain their queues after generation is over...
+  ScopedPhase phase(eProfilePhase_Simulate);
+  for (size_t i = 0; i < _shards.size(); ++i) {
+    Flush(i);
+  }
+  _done.store(true, std::memory_order_release);
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  result->Clear();
+  for (size_t i = 0; i < _shards.size(); ++i) {
+    result->MergeShard(*_shards[i], i, _shards.size());
+  }
+}
+
+void ShardedSimulation::Push(const MemoryRequest &request) {
+  if (MemoryRequest::eKind_SetOwner == request.kind) {
+    _owner = static_cast<uint16_t>(request.address);
+    return;
+  }
+
+  // Sample boundaries and decoded blocks don't matter without banks or a
+  // decoded block cache, and blocks are plain accesses without a block
+  // buffer...
+  if ((MemoryRequest::eKind_Access != request.kind &&
+       MemoryRequest::eKind_AccessBlock != request.kind) || 0 == request.num_bytes) {
+    return;
+  }
+
+  const size_t end_address = request.address + request.num_bytes;
+  const size_t last_line = (end_address - 1) >> _line_shift;
+  for (size_t line = request.address >> _line_shift; line <= last_line; ++line) {
+    const size_t begin = std::max(request.address, line << _line_shift);
+    const size_t end = std::min(end_address, (line + 1) << _line_shift);
+    const size_t shard = (line % _num_sets) % _shards.size();
+
+    CacheRequest r = { begin, static_cast<uint32_t>(end - begin), _owner, 0 };
+    _pending[shard].push_back(r);
+    if (_pending[shard].size() == kBatchSize) {
+      Flush(shard);
+    }
+  }
+}
+
+void ShardedSimulation::Flush(size_t shard) {
+  _queues[shard]->Push(_pending[shard].data(), _pending[shard].size());
+  _pending[shard].clear();
+}
+
+void ShardedSimulation::WorkerLoop(size_t shard) {
+  RequestQueue *queue = _queues[shard].get();
+  Cache *c = _shards[shard].get();
+  for (;;) {
+    // Read the flag before looking at the queue, so that nothing pushed
+    // before it was set can be missed...
+    const bool done = _done.load(std::memory_order_acquire);
+
+    const CacheRequest *requests = nullptr;
+    const size_t n = queue->Peek(&requests);
+    if (n > 0) {
+      c->AccessBatch(requests, n);
+      queue->Pop(n);
+    } else if (done) {
+      return;
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
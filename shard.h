@@ -0,0 +1,88 @@
+#ifndef __SHARD_H__
+#define __SHARD_H__
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "cache.h"
+
+// Bounded single-producer single-consumer queue of cache requests. The
+// producer and the consumer each own one index and only ever read the
+// other's, so neither side takes a lock.
+class RequestQueue {
+ public:
+  // capacity must be a power of two.
+  explicit RequestQueue(size_t capacity);
+
+  // Producer side: blocks while the queue is full.
+  void Push(const CacheRequest *requests, size_t num_requests);
+
+  // Consumer side: the requests that can be read without wrapping around,
+  // and releasing the first num_requests of them.
+  size_t Peek(const CacheRequest **requests);
+  void Pop(size_t num_requests);
+
+  void Reset() { _head.store(0); _tail.store(0); _cached_head = _cached_tail = 0; }
+
+ private:
+  std::vector<CacheRequest> _buffer;
+  const size_t _mask;
+
+  // Written by the consumer; the producer keeps its last reading.
+  std::atomic<size_t> _head;
+  size_t _cached_head;
+  char _pad[64];
+
+  // Written by the producer; the consumer keeps its last reading.
+  std::atomic<size_t> _tail;
+  size_t _cached_tail;
+};
+
+// Simulates one set-associative cache on several threads. Sets never
+// interact, so each shard thread simulates its own copy of the cache but
+// only ever sees the lines of the sets with index % num_shards equal to
+// its number. The generating thread splits every request into lines and
+// queues each to the shard owning its set. At the end the shards are
+// merged back into a single cache whose state and statistics are those
+// of a serial run.
+//
+// Only features that stay within a set can be sharded: no victim cache,
+// block buffer, decoded block cache or banks.
+class ShardedSimulation : public RequestSink {
+ public:
+  static const size_t kQueueSize = 1 << 14;
+  static const size_t kBatchSize = 256;
+
+  ShardedSimulation(const CacheConfig &config, int num_shards);
+
+  static bool CanShard(const CacheConfig &config) {
+    return config.num_ways > 0 && 0 == config.victim_entries &&
+      0 == config.block_buffer_entries && 0 == config.decoded_cache_texels &&
+      0 == config.num_banks;
+  }
+
+  // Simulates the requests that generate sends to the cache it is given,
+  // leaving the results in result, which must have the same config.
+  void Run(const std::function<void(Cache *)> &generate, Cache *result);
+
+  virtual void Push(const MemoryRequest &request);
+
+ private:
+  // Queues the pending requests of a shard.
+  void Flush(size_t shard);
+  void WorkerLoop(size_t shard);
+
+  const int _line_shift;
+  const size_t _num_sets;
+  Cache _recorder;
+  uint16_t _owner;
+
+  std::vector<std::unique_ptr<Cache> > _shards;
+  std::vector<std::unique_ptr<RequestQueue> > _queues;
+  std::vector<std::vector<CacheRequest> > _pending;
+  std::atomic<bool> _done;
+};
+
+#endif  // __SHARD_H__
@@ -1,93 +1,179 @@
 #include <iostream>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
+static void PrintUsage(const char *prog) {
+  std::cerr << "Usage: " << prog << " [-b WxH] [-s WxH] [-o X,Y]... <filename>" << std::endl;
+  std::cerr << "  -b  source block size (default 12x12)" << std::endl;
+  std::cerr << "  -s  sub-block size (default 8x8)" << std::endl;
+  std::cerr << "  -o  sub-block offset within each block, once per output image" << std::endl;
+  std::cerr << "      (default 0,0 4,0 0,4 4,4)" << std::endl;
+}
+
+// One output image: the sub-block at (offset_x, offset_y) of every source
+// block, packed together.
+struct SplitImage {
+  int offset_x;
+  int offset_y;
+  std::string filename;
+
+  std::once_flag alloc_flag;
+  std::vector<unsigned char> pixels;
+  std::atomic<int> rows_left;
+};
+
 int main(int argc, char **argv) {
-  if (argc != 2) {
-    std::cerr << "Usage: " << argv[0] << " <filename>" << std::endl;
-    return 1;
+  int block_w = 12, block_h = 12;
+  int sub_w = 8, sub_h = 8;
+  std::vector<std::pair<int, int> > offsets;
+  const char *filename = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    bool ok = true;
+    if (arg == "-b" && i + 1 < argc) {
+      ok = 2 == sscanf(argv[++i], "%dx%d", &block_w, &block_h);
+    } else if (arg == "-s" && i + 1 < argc) {
+      ok = 2 == sscanf(argv[++i], "%dx%d", &sub_w, &sub_h);
+    } else if (arg == "-o" && i + 1 < argc) {
+      int ox, oy;
+      ok = 2 == sscanf(argv[++i], "%d,%d", &ox, &oy);
+      offsets.push_back(std::make_pair(ox, oy));
+    } else if (nullptr == filename && arg[0] != '-') {
+      filename = argv[i];
+    } else {
+      ok = false;
+    }
+
+    if (!ok) {
+      PrintUsage(argv[0]);
+      return 1;
+    }
   }
 
-  int x, y, n;
-  unsigned char *data = stbi_load(argv[1], &x, &y, &n, 0);
-  if (nullptr == data) {
-    std::cerr << "Error loading file: " << argv[1] << std::endl;
+  if (nullptr == filename) {
+    PrintUsage(argv[0]);
     return 1;
   }
 
-  if (x % 12 != 0 || y % 12 != 0) {
-    std::cerr << "Image dimension not multiple of 12!";
-    stbi_image_free(data);
+  if (offsets.empty()) {
+    offsets.push_back(std::make_pair(0, 0));
+    offsets.push_back(std::make_pair(4, 0));
+    offsets.push_back(std::make_pair(0, 4));
+    offsets.push_back(std::make_pair(4, 4));
+  }
+
+  if (block_w <= 0 || block_h <= 0 || sub_w <= 0 || sub_h <= 0) {
+    std::cerr << "Block sizes must be positive!" << std::endl;
     return 1;
   }
 
-  // Compute block sizes...
-  const int blocks_x = x / 12;
-  const int blocks_y = y / 12;
-
-  const int dst_x = blocks_x * 8;
-  const int dst_y = blocks_y * 8;
-  const int dst_sz = dst_y * dst_x;
-
-  // Define our four split images...
-  unsigned char *top_left = new unsigned char[dst_sz * n];
-  unsigned char *top_right = new unsigned char[dst_sz * n];
-  unsigned char *bottom_left = new unsigned char[dst_sz * n];
-  unsigned char *bottom_right = new unsigned char[dst_sz * n];
-
-  // Do the image split...
-  for (int j = 0; j < y; j += 12) {
-    for (int i = 0; i < x; i += 12) {
-#define POPULATE_AT(dst, offset_x, offset_y) \
-      do { \
-      for (int q = 0; q < 8; ++q) { \
-        for (int p = 0; p < 8; ++p) { \
-          const int src_xx = i + p + offset_x; \
-          const int src_yy = j + q + offset_y; \
-          const int src_idx = (src_yy * x + src_xx) * n; \
-          \
-          const int dst_xx = (i / 12) * 8 + p; \
-          const int dst_yy = (j / 12) * 8 + q; \
-          const int dst_idx = (dst_yy * dst_x + dst_xx) * n; \
-          \
-          memcpy(dst + dst_idx, data + src_idx, n);  \
-        } \
-      } \
-    } while(0)
-
-      POPULATE_AT(top_left, 0, 0);
-      POPULATE_AT(top_right, 4, 0);
-      POPULATE_AT(bottom_left, 0, 4);
-      POPULATE_AT(bottom_right, 4, 4);
+  for (const auto &offset : offsets) {
+    if (offset.first < 0 || offset.second < 0 ||
+        offset.first + sub_w > block_w || offset.second + sub_h > block_h) {
+      std::cerr << "Sub-block at " << offset.first << "," << offset.second
+                << " doesn't fit in a " << block_w << "x" << block_h << " block!" << std::endl;
+      return 1;
     }
   }
 
-  // Spit out the images
-  if (!stbi_write_png("split.0.png", dst_x, dst_y, n, top_left, dst_x * n)) {
-    std::cerr << "Image write error: split.0.png" << std::endl;
+  int x, y, n;
+  unsigned char *data = stbi_load(filename, &x, &y, &n, 0);
+  if (nullptr == data) {
+    std::cerr << "Error loading file: " << filename << std::endl;
+    return 1;
   }
 
-  if (!stbi_write_png("split.1.png", dst_x, dst_y, n, top_right, dst_x * n)) {
-    std::cerr << "Image write error: split.1.png" << std::endl;
+  if (x % block_w != 0 || y % block_h != 0) {
+    std::cerr << "Image dimension not multiple of " << block_w << "x" << block_h << "!" << std::endl;
+    stbi_image_free(data);
+    return 1;
   }
 
-  if (!stbi_write_png("split.2.png", dst_x, dst_y, n, bottom_left, dst_x * n)) {
-    std::cerr << "Image write error: split.2.png" << std::endl;
+  // Compute block sizes...
+  const int blocks_x = x / block_w;
+  const int blocks_y = y / block_h;
+
+  const int dst_x = blocks_x * sub_w;
+  const int dst_y = blocks_y * sub_h;
+  const size_t dst_sz = static_cast<size_t>(dst_y) * dst_x * n;
+
+  // Define our split images...
+  const int num_images = static_cast<int>(offsets.size());
+  std::vector<SplitImage> images(num_images);
+  for (int i = 0; i < num_images; ++i) {
+    images[i].offset_x = offsets[i].first;
+    images[i].offset_y = offsets[i].second;
+    images[i].filename = "split." + std::to_string(i) + ".png";
+    images[i].rows_left = blocks_y;
   }
 
-  if (!stbi_write_png("split.3.png", dst_x, dst_y, n, bottom_right, dst_x * n)) {
-    std::cerr << "Image write error: split.3.png" << std::endl;
-  }
+  // Each task copies one row of blocks into one image. Tasks are ordered
+  // image by image, so the first images finish early and are encoded by
+  // the worker that completes them while the others are still being
+  // copied. Each image's buffer only lives from its first row to the end
+  // of its encode.
+  const int num_tasks = num_images * blocks_y;
+  std::atomic<int> next_task(0);
+  std::atomic<bool> write_error(false);
+
+  auto worker = [&]() {
+    for (int task = next_task++; task < num_tasks; task = next_task++) {
+      SplitImage &img = images[task / blocks_y];
+      const int block_row = task % blocks_y;
+
+      std::call_once(img.alloc_flag, [&img, dst_sz] { img.pixels.resize(dst_sz); });
+
+      const size_t row_bytes = static_cast<size_t>(sub_w) * n;
+      for (int q = 0; q < sub_h; ++q) {
+        const int src_yy = block_row * block_h + img.offset_y + q;
+        const unsigned char *src = data + (static_cast<size_t>(src_yy) * x + img.offset_x) * n;
+
+        const int dst_yy = block_row * sub_h + q;
+        unsigned char *dst = img.pixels.data() + static_cast<size_t>(dst_yy) * dst_x * n;
+
+        for (int b = 0; b < blocks_x; ++b) {
+          memcpy(dst, src, row_bytes);
+          src += static_cast<size_t>(block_w) * n;
+          dst += row_bytes;
+        }
+      }
+
+      // Last row of this image? Spit it out...
+      if (1 == img.rows_left--) {
+        if (!stbi_write_png(img.filename.c_str(), dst_x, dst_y, n, img.pixels.data(), dst_x * n)) {
+          std::cerr << "Image write error: " << img.filename << std::endl;
+          write_error = true;
+        }
+        std::vector<unsigned char>().swap(img.pixels);
+      }
+    }
+  };
 
-  delete [] top_left;
-  delete [] top_right;
-  delete [] bottom_left;
-  delete [] bottom_right;
+  const int num_threads =
+    std::max(1, std::min(num_tasks, static_cast<int>(std::thread::hardware_concurrency())));
+  std::vector<std::thread> threads;
+  for (int i = 1; i < num_threads; ++i) {
+    threads.push_back(std::thread(worker));
+  }
+  worker();
+  for (auto &t : threads) {
+    t.join();
+  }
 
   stbi_image_free(data);
-  return 0;
+  return write_error ? 1 : 0;
 }
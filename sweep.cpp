@@ -0,0 +1,92 @@
+#include "sweep.h"
+
+#include <algorithm>
+
+#include "profiler.h"
+
+Sweep::Sweep(const std::vector<CacheConfig> &configs, int num_threads, size_t chunk_size)
+  : _chunk_size(chunk_size)
+  , _recorder(CacheConfig())
+  , _num_workers(0)
+  , _generation(0)
+  , _num_done(0)
+  , _shutdown(false) {
+  for (const CacheConfig &config : configs) {
+    _caches.push_back(std::unique_ptr<Cache>(new Cache(config)));
+  }
+
+  _chunk.reserve(chunk_size);
+  _published.reserve(chunk_size);
+  _recorder.SetSink(this);
+
+  _num_workers =
+    std::max<size_t>(1, std::min(_caches.size(), static_cast<size_t>(std::max(1, num_threads))));
+  _num_done = _num_workers;
+  for (size_t i = 0; i < _num_workers; ++i) {
+    _workers.push_back(std::thread(&Sweep::WorkerLoop, this, i));
+  }
+}
+
+Sweep::~Sweep() {
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _shutdown = true;
+  }
+  _work_ready.notify_all();
+  for (auto &t : _workers) {
+    t.join();
+  }
+}
+
+void Sweep::Run(const std::function<void(Cache *)> &generate) {
+  for (auto &c : _caches) {
+    c->Clear();
+  }
+
+  generate(&_recorder);
+
+  // The workers replay the last chunk after generation is over...
+  ScopedPhase phase(eProfilePhase_Simulate);
+  Publish();
+  WaitForWorkers();
+}
+
+void Sweep::WaitForWorkers() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _work_done.wait(lock, [this] { return _num_done == _num_workers; });
+}
+
+void Sweep::Publish() {
+  WaitForWorkers();
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _chunk.swap(_published);
+    _num_done = 0;
+    _generation++;
+  }
+  _chunk.clear();
+  _work_ready.notify_all();
+}
+
+void Sweep::WorkerLoop(size_t worker) {
+  size_t seen = 0;
+  std::unique_lock<std::mutex> lock(_mutex);
+  for (;;) {
+    _work_ready.wait(lock, [this, seen] { return _shutdown || _generation != seen; });
+    if (_shutdown) {
+      return;
+    }
+    seen = _generation;
+
+    // _published doesn't change until every worker is done with it...
+    lock.unlock();
+    for (size_t i = worker; i < _caches.size(); i += _num_workers) {
+      _caches[i]->Replay(_published.data(), _published.size());
+    }
+    lock.lock();
+
+    if (++_num_done == _num_workers) {
+      _work_done.notify_one();
+    }
+  }
+}
@@ -0,0 +1,63 @@
+#ifndef __SWEEP_H__
+#define __SWEEP_H__
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "cache.h"
+
+// Simulates many cache configurations over one address stream. The
+// stream is generated once into fixed-size chunks; each full chunk is
+// handed to a pool of worker threads that replay it into their share of
+// the caches while the next chunk is being generated.
+class Sweep : public RequestSink {
+ public:
+  static const size_t kDefaultChunkSize = 1 << 16;
+
+  Sweep(const std::vector<CacheConfig> &configs, int num_threads,
+        size_t chunk_size = kDefaultChunkSize);
+  virtual ~Sweep();
+
+  // Clears every cache and replays into them all the requests that
+  // generate sends to the cache it is given.
+  void Run(const std::function<void(Cache *)> &generate);
+
+  size_t GetNumCaches() const { return _caches.size(); }
+  Cache &GetCache(size_t i) { return *_caches[i]; }
+
+  virtual void Push(const MemoryRequest &request) {
+    _chunk.push_back(request);
+    if (_chunk.size() == _chunk_size) {
+      Publish();
+    }
+  }
+
+ private:
+  // Waits for the workers to finish the previous chunk and hands them the
+  // current one.
+  void Publish();
+  void WaitForWorkers();
+  void WorkerLoop(size_t worker);
+
+  const size_t _chunk_size;
+  std::vector<std::unique_ptr<Cache> > _caches;
+  Cache _recorder;
+
+  std::vector<MemoryRequest> _chunk;
+  std::vector<MemoryRequest> _published;
+
+  size_t _num_workers;
+  std::vector<std::thread> _workers;
+  std::mutex _mutex;
+  std::condition_variable _work_ready;
+  std::condition_variable _work_done;
+  size_t _generation;
+  size_t _num_done;
+  bool _shutdown;
+};
+
+#endif  // __SWEEP_H__
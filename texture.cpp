@@ -1,5 +1,6 @@
 #include "texture.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <unordered_map>
@@ -8,18 +9,56 @@
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#include "block_type_stats.h"
 #include "cache.h"
+#include "curve.h"
+#include "heatmap.h"
+#include "profiler.h"
 
 static const int kASTCBlockSize = 16;
 
+// Indices into a num_blocks_x x num_blocks_y grid of blocks in the order
+// given. First-touch orders are the touched blocks and may omit some.
+static std::vector<int> BlockVisitOrder(EBlockOrder order, int num_blocks_x, int num_blocks_y,
+                                        const std::vector<int> &first_touches) {
+  std::vector<int> visits;
+  auto visit = [&visits, num_blocks_x](int x, int y) { visits.push_back(y * num_blocks_x + x); };
+  switch (order) {
+    case eBlockOrder_Raster:
+      for (int y = 0; y < num_blocks_y; ++y) {
+        for (int x = 0; x < num_blocks_x; ++x) {
+          visit(x, y);
+        }
+      }
+      break;
+
+    case eBlockOrder_Morton:
+      TraverseMorton(num_blocks_x, num_blocks_y, visit);
+      break;
+
+    case eBlockOrder_Hilbert:
+      TraverseHilbert(num_blocks_x, num_blocks_y, visit);
+      break;
+
+    case eBlockOrder_FirstTouch:
+      visits = first_touches;
+      break;
+
+    case kNumBlockOrders:
+      assert(false);
+      break;
+  }
+  return visits;
+}
+
 class ASTCTexture : public Texture {
  public:
-  ASTCTexture(int width, int height, int block_sz_x, int block_sz_y)
-    : Texture(width, height)
+  ASTCTexture(ETextureType type, int width, int height, int block_sz_x, int block_sz_y)
+    : Texture(type, width, height)
     , _block_sz_x(block_sz_x)
     , _block_sz_y(block_sz_y)
     , _num_blocks_x((GetWidth() + block_sz_x - 1) / block_sz_x)
-    , _num_blocks_y((GetWidth() + block_sz_y - 1) / block_sz_y)
+    , _num_blocks_y((GetHeight() + block_sz_y - 1) / block_sz_y)
   { }
   virtual ~ASTCTexture() { }
 
@@ -32,10 +71,39 @@ class ASTCTexture : public Texture {
     int block_offset = block_y * _num_blocks_x + block_x;
 
     // The block address:
-    int block_addr = block_offset * kASTCBlockSize;
+    size_t block_addr = GetBaseAddress() + block_offset * kASTCBlockSize;
 
     // Update cache...
-    c->Access(block_addr, 16);
+    c->AccessBlock(block_addr, 16);
+  }
+
+  virtual void AccessBatch(const std::pair<int, int> *texels, size_t num_texels,
+                           std::vector<CacheRequest> *requests) const {
+    const size_t base = GetBaseAddress();
+    const size_t first = requests->size();
+    requests->resize(first + num_texels);
+
+    CacheRequest *out = requests->data() + first;
+    for (size_t i = 0; i < num_texels; ++i) {
+      const int block_offset =
+        (texels[i].second / _block_sz_y) * _num_blocks_x + texels[i].first / _block_sz_x;
+      out[i].address = base + block_offset * kASTCBlockSize;
+      out[i].num_bytes = kASTCBlockSize;
+      out[i].owner = 0;
+      out[i].end_of_sample = 1;
+    }
+  }
+
+  virtual DecodedBlock GetDecodedBlock(int x, int y) const {
+    DecodedBlock block;
+    block.id = (y / _block_sz_y) * _num_blocks_x + (x / _block_sz_x);
+    block.num_texels = _block_sz_x * _block_sz_y;
+    block.num_decodes = 1;
+    return block;
+  }
+
+  virtual size_t GetSizeInBytes() const {
+    return static_cast<size_t>(_num_blocks_x) * _num_blocks_y * kASTCBlockSize;
   }
 
  private:
@@ -49,12 +117,15 @@ class ASTCTexture : public Texture {
 class Metadata4x4Texture : public Texture {
  public:
   Metadata4x4Texture(int width, int height, const std::unordered_map<int, int> &duplicates,
-                     int num_channels, const unsigned char *vis_image_data)
-    : Texture(width, height)
+                     int num_channels, const unsigned char *vis_image_data,
+                     const LayoutOptions &layout)
+    : Texture(eTextureType_Adaptive4x4, width, height)
     , _next_block_idx(0)
+    , _num_stored_blocks(0)
     , _num_blocks_x((width + 3) / 4)
     , _num_blocks_y((height + 3) / 4)
-    , _metadata(_num_blocks_x * _num_blocks_y, MetadataEntry()) {
+    , _metadata(_num_blocks_x * _num_blocks_y, MetadataEntry())
+    , _layout(layout) {
 
     UpdateImage<12>(width, height, 0xFF0000FF, vis_image_data, num_channels, eBlockType_12x12_0);
     UpdateImage<8>(width, height, 0xFFFF0000, vis_image_data, num_channels, eBlockType_8x8_0);
@@ -114,6 +185,12 @@ class Metadata4x4Texture : public Texture {
         entry.SetBlockOffset(offset - low);
       }
     }
+
+    for (const auto &entry : _metadata) {
+      _num_stored_blocks = std::max(_num_stored_blocks, entry.GetBlockOffset() + 1);
+    }
+
+    BuildMetadata();
   }
 
   virtual ~Metadata4x4Texture() { }
@@ -127,15 +204,112 @@ class Metadata4x4Texture : public Texture {
     int block_idx = block_y * _num_blocks_x + block_x;
 
     // Lookup offset in metadata
-    c->Access(block_idx * 3, 3);
+    BlockTypeStats *stats = GetBlockTypeStats();
+    BlockTypeStats::Mark mark;
+    if (nullptr != stats) {
+      mark = BlockTypeStats::Mark(*c);
+    }
+    _encoding.Access(GetBaseAddress(), block_idx, c);
     const MetadataEntry &entry = _metadata[block_idx];
     int offset = entry.GetBlockOffset();
+    if (nullptr != stats) {
+      stats->Record(GetSizeClass(entry.GetBlockType()), BlockTypeStats::ePart_Metadata, *c, &mark);
+    }
 
     // The block address:
-    int block_addr = 3 * _metadata.size() + offset * kASTCBlockSize;
+    size_t block_addr = GetBaseAddress() + _encoding.GetSizeInBytes() + offset * kASTCBlockSize;
 
     // Update cache...
-    c->Access(block_addr, 16);
+    c->AccessBlock(block_addr, 16);
+    if (nullptr != stats) {
+      stats->Record(GetSizeClass(entry.GetBlockType()), BlockTypeStats::ePart_Payload, *c, &mark);
+    }
+  }
+
+  virtual void AccessBatch(const std::pair<int, int> *texels, size_t num_texels,
+                           std::vector<CacheRequest> *requests) const {
+    const size_t base = GetBaseAddress();
+    const size_t payload = base + _encoding.GetSizeInBytes();
+    requests->reserve(requests->size() + 3 * num_texels);
+    for (size_t i = 0; i < num_texels; ++i) {
+      const int block_idx = (texels[i].second / 4) * _num_blocks_x + texels[i].first / 4;
+      _encoding.AppendRequests(base, block_idx, requests);
+
+      const int offset = _metadata[block_idx].GetBlockOffset();
+      CacheRequest block = { payload + offset * kASTCBlockSize, kASTCBlockSize, 0, 1 };
+      requests->push_back(block);
+    }
+  }
+
+  virtual std::vector<std::string> GetBlockTypeNames() const {
+    std::vector<std::string> names;
+    names.push_back("4x4");
+    names.push_back("8x8");
+    names.push_back("12x12");
+    return names;
+  }
+
+  virtual DecodedBlock GetDecodedBlock(int x, int y) const {
+    const MetadataEntry &entry = _metadata[(y / 4) * _num_blocks_x + (x / 4)];
+
+    // Regions that are part of a larger block share its decode...
+    DecodedBlock block;
+    block.id = entry.GetBlockOffset();
+    block.num_decodes = 1;
+    if (entry.GetBlockType() >= eBlockType_12x12_0) {
+      block.num_texels = 144;
+    } else if (entry.GetBlockType() >= eBlockType_8x8_0) {
+      block.num_texels = 64;
+    } else {
+      block.num_texels = 16;
+    }
+    return block;
+  }
+
+  virtual size_t GetSizeInBytes() const {
+    return _encoding.GetSizeInBytes() + _num_stored_blocks * kASTCBlockSize;
+  }
+
+  virtual size_t GetMetadataSizeInBytes() const {
+    return _encoding.GetSizeInBytes();
+  }
+
+  virtual LayoutStats GetLayoutStats() const {
+    // Stored blocks are single ASTC blocks, so they never cross lines...
+    LayoutStats stats;
+    stats.num_blocks = _num_stored_blocks;
+    stats.payload_bytes = _num_stored_blocks * kASTCBlockSize;
+    stats.padding_bytes = 0;
+    stats.num_line_crossings = 0;
+    stats.num_lines_touched = _num_stored_blocks;
+    stats.metadata_fetches_per_lookup = _encoding.GetFetchesPerLookup();
+    stats.metadata_decode_ops_per_lookup = _encoding.GetDecodeOpsPerLookup();
+    return stats;
+  }
+
+  virtual void ReorderBlocks(EBlockOrder order, const std::vector<int> &first_touches) {
+    // Stored blocks are shared by every region of a larger block and by
+    // duplicates, so renumber them by first visit and remap all entries.
+    std::vector<int> new_offset(_num_stored_blocks, -1);
+    int next_offset = 0;
+    for (int block_idx : BlockVisitOrder(order, _num_blocks_x, _num_blocks_y, first_touches)) {
+      int &offset = new_offset[_metadata[block_idx].GetBlockOffset()];
+      if (offset < 0) {
+        offset = next_offset++;
+      }
+    }
+
+    for (int &offset : new_offset) {
+      if (offset < 0) {
+        offset = next_offset++;
+      }
+    }
+
+    for (auto &entry : _metadata) {
+      entry.SetBlockOffset(new_offset[entry.GetBlockOffset()]);
+    }
+
+    BuildMetadata();
   }
 
  private:
@@ -158,6 +332,17 @@ class Metadata4x4Texture : public Texture {
     eBlockType_12x12_9,
   };
 
+  // The types of the regions of a larger block are that block's size,
+  // which is what the block type stats report.
+  static int GetSizeClass(EBlockType type) {
+    if (type >= eBlockType_12x12_0) {
+      return 2;
+    } else if (type >= eBlockType_8x8_0) {
+      return 1;
+    }
+    return 0;
+  }
+
   class MetadataEntry {
    public:
     MetadataEntry() : _offset(-1), _type(eBlockType_4x4) { }
@@ -179,9 +364,10 @@ class Metadata4x4Texture : public Texture {
     assert(kBlockSize % 4 == 0);
     const int k4x4BlocksPerBlock = kBlockSize / 4;
 
-    // Go through the vis image in incremental block sizes...
-    for (int j = 0; j < height; j += kBlockSize) {
-      for (int i = 0; i < width; i += kBlockSize) {
+    // Go through the vis image in incremental block sizes. Regions cut off
+    // by the edge of the image can't hold a whole block...
+    for (int j = 0; j + static_cast<int>(kBlockSize) <= height; j += kBlockSize) {
+      for (int i = 0; i + static_cast<int>(kBlockSize) <= width; i += kBlockSize) {
 
         int good_blocks[k4x4BlocksPerBlock * k4x4BlocksPerBlock];
         memset(good_blocks, 0xFF, sizeof(good_blocks));
@@ -232,31 +418,48 @@ class Metadata4x4Texture : public Texture {
     }
   }
 
+  void BuildMetadata() {
+    std::vector<int> types, offsets;
+    for (const auto &entry : _metadata) {
+      types.push_back(static_cast<int>(entry.GetBlockType()));
+      offsets.push_back(entry.GetBlockOffset());
+    }
+    _encoding.Build(_layout.metadata, _num_blocks_x, _num_blocks_y, eBlockType_12x12_9 + 1,
+                    types, offsets);
+  }
+
   int _next_block_idx;
+  int _num_stored_blocks;
   const int _num_blocks_x;
   const int _num_blocks_y;
   std::vector<MetadataEntry> _metadata;
+  const LayoutOptions _layout;
+  MetadataEncoding _encoding;
 };
 
 class Metadata12x12Texture : public Texture {
  public:
   Metadata12x12Texture(int width, int height, const std::unordered_map<int, int> &duplicates,
-                       int num_channels, const unsigned char *vis_image_data)
-    : Texture(width, height)
+                       int num_channels, const unsigned char *vis_image_data,
+                       const LayoutOptions &layout)
+    : Texture(eTextureType_Adaptive12x12, width, height)
     , _next_block_idx(0)
+    , _num_stored_blocks(0)
     , _num_blocks_x((width + 11) / 12)
     , _num_blocks_y((height + 11) / 12)
-    , _metadata(_num_blocks_x * _num_blocks_y, MetadataEntry()) {
+    , _metadata(_num_blocks_x * _num_blocks_y, MetadataEntry())
+    , _layout(layout)
+    , _source_block(_metadata.size(), -1) {
 
-    int blocks_written = 0;
+    // Classify the unique blocks first so that the packing can see all
+    // of them. Duplicates remember the block they repeat.
+    std::vector<int> unique_blocks;
     int next_block_idx = 0;
     int block_idx = 0;
     for (int j = 0; j < height; j += 12) {
       for (int i = 0; i < width; i += 12) {
-
-        // If we've already visited this block, then just copy it over...
         if (duplicates.at(block_idx) != next_block_idx) {
-          _metadata[block_idx] = _metadata[duplicates.at(block_idx)];
+          _source_block[block_idx] = _source_block[duplicates.at(block_idx)];
         } else {
           next_block_idx++;
 
@@ -264,8 +467,8 @@ class Metadata12x12Texture : public Texture {
           size_t offset = (j * width + i) * num_channels;
           MetadataEntry &e = _metadata[block_idx];
           e.SetBlockType(AnalyzeBlock(vis_image_data + offset, width * num_channels, num_channels));
-          e.SetBlockOffset(blocks_written);
-          blocks_written += e.GetBlocksToRead();
+          _source_block[block_idx] = block_idx;
+          unique_blocks.push_back(block_idx);
         }
 
         block_idx++;
@@ -273,6 +476,7 @@ class Metadata12x12Texture : public Texture {
     }
 
     assert(block_idx == _num_blocks_x * _num_blocks_y);
+    PackBlocks(unique_blocks);
   }
 
   virtual ~Metadata12x12Texture() { }
@@ -286,15 +490,98 @@ class Metadata12x12Texture : public Texture {
     int block_idx = block_y * _num_blocks_x + block_x;
 
     // Lookup offset in metadata
-    c->Access(block_idx * 3, 3);
+    BlockTypeStats *stats = GetBlockTypeStats();
+    BlockTypeStats::Mark mark;
+    if (nullptr != stats) {
+      mark = BlockTypeStats::Mark(*c);
+    }
+    _encoding.Access(GetBaseAddress(), block_idx, c);
     const MetadataEntry &entry = _metadata[block_idx];
     int offset = entry.GetBlockOffset();
+    if (nullptr != stats) {
+      stats->Record(entry.GetBlockType(), BlockTypeStats::ePart_Metadata, *c, &mark);
+    }
 
     // The block address:
-    int block_addr = 3 * _metadata.size() + offset * kASTCBlockSize;
+    size_t block_addr = GetBaseAddress() + _payload_offset + offset * kASTCBlockSize;
 
     // Update cache...
-    c->Access(block_addr, entry.GetBlocksToRead() * 16);
+    c->AccessBlock(block_addr, entry.GetBlocksToRead() * 16);
+    if (nullptr != stats) {
+      stats->Record(entry.GetBlockType(), BlockTypeStats::ePart_Payload, *c, &mark);
+    }
+  }
+
+  virtual void AccessBatch(const std::pair<int, int> *texels, size_t num_texels,
+                           std::vector<CacheRequest> *requests) const {
+    const size_t base = GetBaseAddress();
+    const size_t payload = base + _payload_offset;
+    requests->reserve(requests->size() + 3 * num_texels);
+    for (size_t i = 0; i < num_texels; ++i) {
+      const int block_idx = (texels[i].second / 12) * _num_blocks_x + texels[i].first / 12;
+      _encoding.AppendRequests(base, block_idx, requests);
+
+      const MetadataEntry &entry = _metadata[block_idx];
+      CacheRequest block = {
+        payload + entry.GetBlockOffset() * kASTCBlockSize,
+        static_cast<uint32_t>(entry.GetBlocksToRead() * kASTCBlockSize), 0, 1
+      };
+      requests->push_back(block);
+    }
+  }
+
+  // Indexed by EBlockType.
+  virtual std::vector<std::string> GetBlockTypeNames() const {
+    std::vector<std::string> names;
+    names.push_back("4x4");
+    names.push_back("6x6");
+    names.push_back("8x8 (0, 0)");
+    names.push_back("8x8 (4, 0)");
+    names.push_back("8x8 (0, 4)");
+    names.push_back("8x8 (4, 4)");
+    names.push_back("12x12");
+    return names;
+  }
+
+  virtual DecodedBlock GetDecodedBlock(int x, int y) const {
+    const MetadataEntry &entry = _metadata[(y / 12) * _num_blocks_x + (x / 12)];
+
+    // Every ASTC block covering the region has to be decoded...
+    DecodedBlock block;
+    block.id = entry.GetBlockOffset();
+    block.num_texels = 144;
+    block.num_decodes = entry.GetBlocksToRead();
+    return block;
+  }
+
+  virtual size_t GetSizeInBytes() const {
+    return _payload_offset + _num_stored_blocks * kASTCBlockSize;
+  }
+
+  virtual size_t GetMetadataSizeInBytes() const {
+    return _encoding.GetSizeInBytes();
+  }
+
+  virtual LayoutStats GetLayoutStats() const { return _layout_stats; }
+
+  virtual void ReorderBlocks(EBlockOrder order, const std::vector<int> &first_touches) {
+    std::vector<bool> placed(_metadata.size(), false);
+    std::vector<int> unique_blocks;
+    for (int block_idx : BlockVisitOrder(order, _num_blocks_x, _num_blocks_y, first_touches)) {
+      const int source = _source_block[block_idx];
+      if (!placed[source]) {
+        placed[source] = true;
+        unique_blocks.push_back(source);
+      }
+    }
+
+    for (size_t i = 0; i < _metadata.size(); ++i) {
+      if (_source_block[i] == static_cast<int>(i) && !placed[i]) {
+        unique_blocks.push_back(static_cast<int>(i));
+      }
+    }
+
+    PackBlocks(unique_blocks);
   }
 
  private:
@@ -457,22 +744,217 @@ class Metadata12x12Texture : public Texture {
     EBlockType _type;
   };
 
+  // Stores the unique blocks in the given order: assigns their offsets,
+  // in ASTC block units from the start of the payload, according to the
+  // packing and points every duplicate at the block it repeats.
+  void PackBlocks(const std::vector<int> &blocks) {
+    const LayoutOptions &layout = _layout;
+    const int line_blocks = std::max(1, static_cast<int>(layout.line_size / kASTCBlockSize));
+    const size_t line_size = static_cast<size_t>(line_blocks) * kASTCBlockSize;
+
+    // Grouping by type stores the blocks one type at a time...
+    std::vector<int> order(blocks);
+    if (eLayoutPacking_GroupedByType == layout.packing) {
+      std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+        return _metadata[a].GetBlockType() < _metadata[b].GetBlockType();
+      });
+    }
+
+    int blocks_written = 0;
+    for (size_t i = 0; i < order.size(); ++i) {
+      MetadataEntry &e = _metadata[order[i]];
+      int size = e.GetBlocksToRead();
+      int offset = blocks_written;
+
+      switch (layout.packing) {
+        case eLayoutPacking_Unaligned:
+          break;
+
+        case eLayoutPacking_LineAligned: {
+          const int min_lines = (size + line_blocks - 1) / line_blocks;
+          const int lines = (offset % line_blocks + size + line_blocks - 1) / line_blocks;
+          if (lines > min_lines) {
+            offset = RoundUp(offset, line_blocks);
+          }
+          break;
+        }
+
+        case eLayoutPacking_PowerOfTwo: {
+          int padded = 1;
+          while (padded < size) {
+            padded <<= 1;
+          }
+          offset = RoundUp(offset, padded);
+          size = padded;
+          break;
+        }
+
+        case eLayoutPacking_GroupedByType:
+          if (i > 0 && _metadata[order[i - 1]].GetBlockType() != e.GetBlockType()) {
+            offset = RoundUp(offset, line_blocks);
+          }
+          break;
+
+        case kNumLayoutPackings:
+          assert(false);
+          break;
+      }
+
+      e.SetBlockOffset(offset);
+      blocks_written = offset + size;
+    }
+
+    _num_stored_blocks = blocks_written;
+
+    std::vector<int> types, offsets;
+    for (size_t i = 0; i < _metadata.size(); ++i) {
+      if (_source_block[i] != static_cast<int>(i)) {
+        _metadata[i] = _metadata[_source_block[i]];
+      }
+      types.push_back(static_cast<int>(_metadata[i].GetBlockType()));
+      offsets.push_back(_metadata[i].GetBlockOffset());
+    }
+
+    // The payload follows the metadata...
+    _encoding.Build(layout.metadata, _num_blocks_x, _num_blocks_y, eBlockType_12x12 + 1,
+                    types, offsets);
+    _payload_offset = _encoding.GetSizeInBytes();
+    if (eLayoutPacking_Unaligned != layout.packing) {
+      _payload_offset = ((_payload_offset + line_size - 1) / line_size) * line_size;
+    }
+
+    ComputeLayoutStats(blocks, layout.line_size);
+  }
+
+  static int RoundUp(int x, int multiple) {
+    return ((x + multiple - 1) / multiple) * multiple;
+  }
+
+  void ComputeLayoutStats(const std::vector<int> &blocks, size_t line_size) {
+    LayoutStats &stats = _layout_stats;
+    stats.num_blocks = blocks.size();
+    stats.payload_bytes = 0;
+    stats.num_line_crossings = 0;
+    stats.num_lines_touched = 0;
+    for (int block_idx : blocks) {
+      const MetadataEntry &e = _metadata[block_idx];
+      const size_t size = e.GetBlocksToRead() * kASTCBlockSize;
+      const size_t start = _payload_offset + e.GetBlockOffset() * kASTCBlockSize;
+      const size_t lines = (start + size - 1) / line_size - start / line_size + 1;
+      stats.payload_bytes += size;
+      stats.num_lines_touched += lines;
+      if (lines > (size + line_size - 1) / line_size) {
+        stats.num_line_crossings++;
+      }
+    }
+    stats.padding_bytes = GetSizeInBytes() - GetMetadataSizeInBytes() - stats.payload_bytes;
+    stats.metadata_fetches_per_lookup = _encoding.GetFetchesPerLookup();
+    stats.metadata_decode_ops_per_lookup = _encoding.GetDecodeOpsPerLookup();
+  }
+
   int _next_block_idx;
+  int _num_stored_blocks;
   const int _num_blocks_x;
   const int _num_blocks_y;
   std::vector<MetadataEntry> _metadata;
+  const LayoutOptions _layout;
+
+  // The unique block that each block repeats, itself if it is unique.
+  std::vector<int> _source_block;
+
+  MetadataEncoding _encoding;
+
+  // Byte offset of the first stored block from the base address.
+  size_t _payload_offset;
+  LayoutStats _layout_stats;
 };
 
+void Texture::Sample(int x, int y, Cache *c) const {
+  if (c->IsRecording()) {
+    c->RecordSample(GetBaseAddress(), GetDecodedBlock(x, y));
+    Access(x, y, c);
+    return;
+  }
+
+  DecodedBlockCache *decoded = c->GetDecodedCache();
+  if (nullptr != decoded && decoded->Lookup(GetBaseAddress(), GetDecodedBlock(x, y))) {
+    if (nullptr != _heatmap) {
+      _heatmap->Record(x, y, true);
+    }
+    return;
+  }
+
+  if (nullptr != _heatmap) {
+    const size_t sectors_filled = c->GetNumSectorsFilled();
+    Access(x, y, c);
+    _heatmap->Record(x, y, sectors_filled == c->GetNumSectorsFilled());
+    return;
+  }
+
+  Access(x, y, c);
+}
+
+const char *GetTextureTypeName(ETextureType type) {
+  switch (type) {
+    case eTextureType_ASTC4x4: return "ASTC4x4";
+    case eTextureType_ASTC6x6: return "ASTC6x6";
+    case eTextureType_ASTC8x8: return "ASTC8x8";
+    case eTextureType_ASTC12x12: return "ASTC12x12";
+    case eTextureType_Adaptive4x4: return "Adaptive4x4";
+    case eTextureType_Adaptive12x12: return "Adaptive12x12";
+  }
+  assert(false);
+  return "";
+}
+
+int GetTextureBlockSize(ETextureType type) {
+  switch (type) {
+    case eTextureType_ASTC4x4: return 4;
+    case eTextureType_ASTC6x6: return 6;
+    case eTextureType_ASTC8x8: return 8;
+    case eTextureType_ASTC12x12: return 12;
+    case eTextureType_Adaptive4x4: return 4;
+    case eTextureType_Adaptive12x12: return 12;
+  }
+  assert(false);
+  return 1;
+}
+
+const char *GetBlockOrderName(EBlockOrder order) {
+  switch (order) {
+    case eBlockOrder_Raster: return "raster";
+    case eBlockOrder_Morton: return "morton";
+    case eBlockOrder_Hilbert: return "hilbert";
+    case eBlockOrder_FirstTouch: return "first-touch";
+    case kNumBlockOrders: break;
+  }
+  assert(false);
+  return "";
+}
+
+const char *GetLayoutPackingName(ELayoutPacking packing) {
+  switch (packing) {
+    case eLayoutPacking_Unaligned: return "unaligned";
+    case eLayoutPacking_LineAligned: return "line-aligned";
+    case eLayoutPacking_PowerOfTwo: return "power-of-two";
+    case eLayoutPacking_GroupedByType: return "grouped-by-type";
+    case kNumLayoutPackings: break;
+  }
+  assert(false);
+  return "";
+}
+
 std::unique_ptr<Texture> Texture::Create(ETextureType type, int width, int height) {
+  ScopedPhase phase(eProfilePhase_Layout);
   switch (type) {
     case eTextureType_ASTC4x4:
-      return std::move(std::unique_ptr<Texture>(new ASTCTexture(width, height, 4, 4)));
+      return std::move(std::unique_ptr<Texture>(new ASTCTexture(eTextureType_ASTC4x4, width, height, 4, 4)));
     case eTextureType_ASTC6x6:
-      return std::move(std::unique_ptr<Texture>(new ASTCTexture(width, height, 6, 6)));
+      return std::move(std::unique_ptr<Texture>(new ASTCTexture(eTextureType_ASTC6x6, width, height, 6, 6)));
     case eTextureType_ASTC8x8:
-      return std::move(std::unique_ptr<Texture>(new ASTCTexture(width, height, 8, 8)));
+      return std::move(std::unique_ptr<Texture>(new ASTCTexture(eTextureType_ASTC8x8, width, height, 8, 8)));
     case eTextureType_ASTC12x12:
-      return std::move(std::unique_ptr<Texture>(new ASTCTexture(width, height, 12, 12)));
+      return std::move(std::unique_ptr<Texture>(new ASTCTexture(eTextureType_ASTC12x12, width, height, 12, 12)));
 
     default:
       assert(false);
@@ -484,7 +966,8 @@ std::unique_ptr<Texture> Texture::Create(ETextureType type, int width, int heigh
 
 std::unique_ptr<Texture> Texture::Create(ETextureType type,
                                          const char *metadata_filename,
-                                         const char *vis_filename) {
+                                         const char *vis_filename,
+                                         const LayoutOptions &layout) {
   // Parse the metadata...
   std::unordered_map<int, int> duplicates;
   std::ifstream dup_file(metadata_filename);
@@ -508,11 +991,24 @@ std::unique_ptr<Texture> Texture::Create(ETextureType type,
   w = (w / 12) * 12;
   h = (h / 12) * 12;
 
+  std::unique_ptr<Texture> result = Create(type, w, h, duplicates, channels, data, layout);
+  stbi_image_free(data);
+  return result;
+}
+
+std::unique_ptr<Texture> Texture::Create(ETextureType type, int width, int height,
+                                         const std::unordered_map<int, int> &duplicates,
+                                         int num_channels,
+                                         const unsigned char *vis_data,
+                                         const LayoutOptions &layout) {
+  ScopedPhase phase(eProfilePhase_Layout);
   switch (type) {
   case eTextureType_Adaptive4x4:
-    return std::move(std::unique_ptr<Texture>(new Metadata4x4Texture(w, h, duplicates, channels, data)));
+    return std::move(std::unique_ptr<Texture>(
+      new Metadata4x4Texture(width, height, duplicates, num_channels, vis_data, layout)));
   case eTextureType_Adaptive12x12:
-    return std::move(std::unique_ptr<Texture>(new Metadata12x12Texture(w, h, duplicates, channels, data)));
+    return std::move(std::unique_ptr<Texture>(
+      new Metadata12x12Texture(width, height, duplicates, num_channels, vis_data, layout)));
   default:
     assert(false);
   }
@@ -1,7 +1,15 @@
 #ifndef __TEXTURE_H__
 #define __TEXTURE_H__
 
+#include <cstddef>
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "decoded_cache.h"
+#include "metadata.h"
 
 enum ETextureType {
   eTextureType_ASTC4x4,
@@ -13,8 +21,83 @@ enum ETextureType {
   eTextureType_Adaptive12x12
 };
 
+const char *GetTextureTypeName(ETextureType type);
+
+// Side in texels of the blocks of a texture type, or of the metadata grid
+// of an adaptive one.
+int GetTextureBlockSize(ETextureType type);
+
+// How an adaptive texture places its compressed blocks in memory. A
+// stored block is all of the ASTC blocks read for one metadata entry.
+enum ELayoutPacking {
+  // Back to back, in the order they are written.
+  eLayoutPacking_Unaligned,
+
+  // Moved to the next line whenever that makes the block touch fewer
+  // lines.
+  eLayoutPacking_LineAligned,
+
+  // Padded to a power-of-two number of ASTC blocks and aligned to that
+  // size.
+  eLayoutPacking_PowerOfTwo,
+
+  // Blocks of the same type stored together, each group starting on a
+  // line boundary.
+  eLayoutPacking_GroupedByType,
+
+  kNumLayoutPackings
+};
+
+const char *GetLayoutPackingName(ELayoutPacking packing);
+
+// The order in which an adaptive texture stores its blocks.
+enum EBlockOrder {
+  eBlockOrder_Raster,
+  eBlockOrder_Morton,
+  eBlockOrder_Hilbert,
+
+  // Blocks in the order a training trace first touches them, followed by
+  // the untouched blocks in raster order.
+  eBlockOrder_FirstTouch,
+
+  kNumBlockOrders
+};
+
+const char *GetBlockOrderName(EBlockOrder order);
+
+struct LayoutOptions {
+  LayoutOptions()
+    : packing(eLayoutPacking_Unaligned), metadata(eMetadataEncoding_Flat), line_size(64) { }
+
+  ELayoutPacking packing;
+  EMetadataEncoding metadata;
+
+  // Line size in bytes that the packing aligns to.
+  size_t line_size;
+};
+
+// Where the bytes of a texture's stored blocks went, measured against
+// the layout's line size.
+struct LayoutStats {
+  size_t num_blocks;
+  size_t payload_bytes;
+  size_t padding_bytes;
+
+  // Stored blocks touching more lines than their size requires, and the
+  // lines touched by all stored blocks.
+  size_t num_line_crossings;
+  size_t num_lines_touched;
+
+  // Cost of finding a block through the metadata encoding.
+  double metadata_fetches_per_lookup;
+  double metadata_decode_ops_per_lookup;
+};
+
 // Forward declare...
+class BlockTypeStats;
 class Cache;
+class Heatmap;
+struct CacheRequest;
 
 class Texture {
  public:
@@ -22,21 +105,99 @@ class Texture {
                                          int width, int height);
   static std::unique_ptr<Texture> Create(ETextureType type,
                                          const char *metadata_filename,
-                                         const char *vis_filename);
+                                         const char *vis_filename,
+                                         const LayoutOptions &layout = LayoutOptions());
+
+  // Builds an adaptive texture from an already loaded visualization
+  // image. duplicates maps each block index to the first identical block.
+  static std::unique_ptr<Texture> Create(ETextureType type, int width, int height,
+                                         const std::unordered_map<int, int> &duplicates,
+                                         int num_channels,
+                                         const unsigned char *vis_data,
+                                         const LayoutOptions &layout = LayoutOptions());
   virtual ~Texture() { }
 
   virtual void Access(int x, int y, Cache *c) const = 0;
 
+  // Appends the requests that Access would send for each texel to
+  // requests, with the last request of each texel marked as the end of a
+  // sample. Cache::AccessBatch then consumes them without a virtual call
+  // per texel.
+  virtual void AccessBatch(const std::pair<int, int> *texels, size_t num_texels,
+                           std::vector<CacheRequest> *requests) const = 0;
+
+  // The unit of decompression that texel (x, y) belongs to.
+  virtual DecodedBlock GetDecodedBlock(int x, int y) const = 0;
+
+  // Samples texel (x, y). If the cache has a decoded block cache and the
+  // texel's block is resident there, no memory is accessed; otherwise
+  // this is Access. Samples are counted in the heatmap, if any, as hits
+  // unless they fill sectors of the cache.
+  void Sample(int x, int y, Cache *c) const;
+
+  // The heatmap that Sample records into, or nullptr. The texture does
+  // not own it.
+  Heatmap *GetHeatmap() const { return _heatmap; }
+  void SetHeatmap(Heatmap *heatmap) { _heatmap = heatmap; }
+
+  // Names of the block types of an adaptive texture, indexing its
+  // BlockTypeStats. Empty for textures with a single block type.
+  virtual std::vector<std::string> GetBlockTypeNames() const {
+    return std::vector<std::string>();
+  }
+
+  // The per block type stats that Access records into, or nullptr. The
+  // texture does not own them.
+  BlockTypeStats *GetBlockTypeStats() const { return _block_type_stats; }
+  void SetBlockTypeStats(BlockTypeStats *stats) { _block_type_stats = stats; }
+
+  // True if samples are recorded as they are simulated, which needs them
+  // to be sent one at a time rather than batched.
+  bool IsInstrumented() const { return nullptr != _heatmap || nullptr != _block_type_stats; }
+
+  // Total number of bytes the texture occupies in memory, including any
+  // metadata stored in front of the compressed blocks.
+  virtual size_t GetSizeInBytes() const = 0;
+
+  // The part of GetSizeInBytes taken by per-block metadata.
+  virtual size_t GetMetadataSizeInBytes() const { return 0; }
+
+  // Packing statistics for textures that store blocks through metadata.
+  // All zero for the others.
+  virtual LayoutStats GetLayoutStats() const {
+    LayoutStats stats = { 0, 0, 0, 0, 0, 0.0, 0 };
+    return stats;
+  }
+
+  // Rewrites the metadata offsets so that the stored blocks follow the
+  // given order, which can change GetSizeInBytes. first_touches is only
+  // used by eBlockOrder_FirstTouch and holds indices into the grid of
+  // GetTextureBlockSize blocks. Textures without metadata have a fixed
+  // layout and ignore this.
+  virtual void ReorderBlocks(EBlockOrder order, const std::vector<int> &first_touches) { }
+
+  ETextureType GetType() const { return _type; }
   int GetWidth() const { return _w; }
   int GetHeight() const { return _h; }
 
+  // All addresses sent to the cache are relative to the base address so
+  // that several textures can share one address space.
+  size_t GetBaseAddress() const { return _base_address; }
+  void SetBaseAddress(size_t addr) { _base_address = addr; }
+
  protected:
-  Texture(int width, int height) : _w(width), _h(height) { }
+  Texture(ETextureType type, int width, int height)
+    : _type(type), _w(width), _h(height), _base_address(0), _heatmap(nullptr)
+    , _block_type_stats(nullptr) { }
 
  private:
   Texture();
+  ETextureType _type;
   int _w;
   int _h;
+  size_t _base_address;
+  Heatmap *_heatmap;
+  BlockTypeStats *_block_type_stats;
 };
 
 #endif  // __TEXTURE_H__
@@ -0,0 +1,253 @@
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "cache.h"
+#include "profiler.h"
+#include "scene.h"
+#include "texture.h"
+
+static const size_t kBinaryRecordSize = 16;
+static const size_t kMaxCSVLineLength = 256;
+
+static bool MapFile(const char *filename, const char **data, size_t *size) {
+#ifdef _WIN32
+  HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size)) {
+    CloseHandle(file);
+    return false;
+  }
+
+  *size = static_cast<size_t>(file_size.QuadPart);
+  *data = nullptr;
+  if (*size > 0) {
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (NULL == mapping) {
+      CloseHandle(file);
+      return false;
+    }
+    *data = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    CloseHandle(mapping);
+  }
+  CloseHandle(file);
+  return *size == 0 || nullptr != *data;
+#else
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+
+  *size = static_cast<size_t>(st.st_size);
+  *data = nullptr;
+  if (*size > 0) {
+    void *addr = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == addr) {
+      close(fd);
+      return false;
+    }
+
+    // We only ever stream through the file once...
+    madvise(addr, *size, MADV_SEQUENTIAL);
+    *data = static_cast<const char *>(addr);
+  }
+  close(fd);
+  return true;
+#endif
+}
+
+static void UnmapFile(const char *data, size_t size) {
+  if (nullptr == data) {
+    return;
+  }
+#ifdef _WIN32
+  UnmapViewOfFile(data);
+#else
+  munmap(const_cast<char *>(data), size);
+#endif
+}
+
+std::unique_ptr<Trace> Trace::Open(const char *filename) {
+  const char *data = nullptr;
+  size_t size = 0;
+  if (!MapFile(filename, &data, &size)) {
+    std::cerr << "Error opening trace: " << filename << std::endl;
+    return nullptr;
+  }
+
+  std::string name(filename);
+  const bool is_csv = name.size() >= 4 && name.compare(name.size() - 4, 4, ".csv") == 0;
+  if (!is_csv && (size % kBinaryRecordSize) != 0) {
+    std::cerr << "Trace size is not a multiple of " << kBinaryRecordSize
+              << " bytes: " << filename << std::endl;
+    UnmapFile(data, size);
+    return nullptr;
+  }
+
+  return std::unique_ptr<Trace>(new Trace(data, size, is_csv));
+}
+
+Trace::Trace(const char *data, size_t size, bool is_csv)
+  : _data(data)
+  , _size(size)
+  , _is_csv(is_csv)
+{ }
+
+Trace::~Trace() {
+  UnmapFile(_data, _size);
+}
+
+// Reads the record at *cursor and advances it. Returns false at the end of
+// the trace; *ok is false if the record was malformed.
+bool Trace::NextRecord(const char **cursor, TraceRecord *rec, bool *ok) const {
+  const char *end = _data + _size;
+  if (*cursor >= end) {
+    return false;
+  }
+
+  if (!_is_csv) {
+    memcpy(rec, *cursor, kBinaryRecordSize);
+    *cursor += kBinaryRecordSize;
+    *ok = true;
+    return true;
+  }
+
+  const char *line_end =
+    static_cast<const char *>(memchr(*cursor, '\n', end - *cursor));
+  if (nullptr == line_end) {
+    line_end = end;
+  }
+
+  // The mapping isn't null terminated, so parse a bounded copy...
+  char line[kMaxCSVLineLength];
+  size_t len = std::min(static_cast<size_t>(line_end - *cursor), kMaxCSVLineLength - 1);
+  memcpy(line, *cursor, len);
+  line[len] = '\0';
+  *cursor = line_end + 1;
+
+  char *p = line;
+  char *next = nullptr;
+  rec->texture_id = static_cast<uint32_t>(strtoul(p, &next, 10));
+  *ok = next != p;
+
+  float *fields[3] = { &rec->u, &rec->v, &rec->lod };
+  for (int i = 0; i < 3 && *ok; ++i) {
+    p = next;
+    while (*p == ',' || *p == ' ' || *p == '\t') {
+      p++;
+    }
+    *fields[i] = strtof(p, &next);
+    *ok = next != p;
+  }
+
+  return true;
+}
+
+static int WrapTexel(float coord, int size) {
+  float t = coord - std::floor(coord);
+  int texel = static_cast<int>(t * size);
+  return std::min(std::max(texel, 0), size - 1);
+}
+
+TraceStats Trace::Run(const Scene &scene, Cache *c) const {
+  ScopedPhase phase(eProfilePhase_Simulate);
+
+  TraceStats stats;
+  memset(&stats, 0, sizeof(stats));
+
+  const char *cursor = _data;
+  TraceRecord rec;
+  bool ok = false;
+  bool first_line = true;
+  while (NextRecord(&cursor, &rec, &ok)) {
+    // Allow a header line at the top of CSV traces, and only there.
+    const bool header_allowed = first_line;
+    first_line = false;
+    if (!ok) {
+      if (!header_allowed) {
+        stats.num_skipped++;
+      }
+      continue;
+    }
+
+    stats.num_records++;
+    if (rec.texture_id >= scene.GetNumTextures() || !std::isfinite(rec.u) ||
+        !std::isfinite(rec.v)) {
+      stats.num_skipped++;
+      continue;
+    }
+
+    if (rec.lod >= 0.5f) {
+      stats.num_lod_clamped++;
+    }
+
+    stats.num_samples++;
+    const std::unique_ptr<Texture> &tex = scene.GetTexture(rec.texture_id);
+    c->SetOwner(static_cast<int>(rec.texture_id));
+    tex->Sample(WrapTexel(rec.u, tex->GetWidth()),
+                WrapTexel(rec.v, tex->GetHeight()), c);
+    c->EndSample();
+  }
+
+  return stats;
+}
+
+std::vector<std::vector<int> > Trace::GetFirstTouches(
+    const std::vector<std::unique_ptr<Texture> > &textures) const {
+  std::vector<std::vector<int> > first_touches(textures.size());
+  std::vector<std::vector<bool> > touched(textures.size());
+  std::vector<int> num_blocks_x(textures.size());
+  for (size_t i = 0; i < textures.size(); ++i) {
+    const int block_size = GetTextureBlockSize(textures[i]->GetType());
+    num_blocks_x[i] = (textures[i]->GetWidth() + block_size - 1) / block_size;
+    const int num_blocks_y = (textures[i]->GetHeight() + block_size - 1) / block_size;
+    touched[i].assign(static_cast<size_t>(num_blocks_x[i]) * num_blocks_y, false);
+  }
+
+  const char *cursor = _data;
+  TraceRecord rec;
+  bool ok = false;
+  while (NextRecord(&cursor, &rec, &ok)) {
+    if (!ok || rec.texture_id >= textures.size() || !std::isfinite(rec.u) ||
+        !std::isfinite(rec.v)) {
+      continue;
+    }
+
+    const std::unique_ptr<Texture> &tex = textures[rec.texture_id];
+    const int block_size = GetTextureBlockSize(tex->GetType());
+    const int block_idx =
+      (WrapTexel(rec.v, tex->GetHeight()) / block_size) * num_blocks_x[rec.texture_id] +
+      WrapTexel(rec.u, tex->GetWidth()) / block_size;
+    if (!touched[rec.texture_id][block_idx]) {
+      touched[rec.texture_id][block_idx] = true;
+      first_touches[rec.texture_id].push_back(block_idx);
+    }
+  }
+
+  return first_touches;
+}
@@ -0,0 +1,70 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Forward declare
+class Cache;
+class Scene;
+class Texture;
+
+// One texture lookup captured from a real frame. Binary traces are a
+// flat array of these records in little-endian order. CSV traces have
+// one "texture_id,u,v,lod" record per line, optionally preceded by a
+// header line.
+struct TraceRecord {
+  uint32_t texture_id;
+  float u;
+  float v;
+  float lod;
+};
+
+struct TraceStats {
+  size_t num_records;
+
+  // Records naming a texture that isn't in the scene or with non-finite
+  // coordinates, and CSV lines other than the first that couldn't be
+  // parsed.
+  size_t num_skipped;
+
+  // Records that were sampled, i.e. neither skipped nor malformed.
+  size_t num_samples;
+
+  // Textures only model their top level, so lookups into coarser mip
+  // levels are sampled from level zero.
+  size_t num_lod_clamped;
+};
+
+// A texture-coordinate trace that is memory-mapped and decoded one record
+// at a time, so dumps larger than RAM can be replayed.
+class Trace {
+ public:
+  // Files ending in .csv are parsed as text, anything else as binary.
+  // Returns nullptr if the file can't be mapped.
+  static std::unique_ptr<Trace> Open(const char *filename);
+  ~Trace();
+
+  // Converts each record to texel coordinates of the texture it names
+  // (with repeat addressing) and accesses that texture.
+  TraceStats Run(const Scene &scene, Cache *c) const;
+
+  // For each texture, the indices of the blocks of its
+  // GetTextureBlockSize grid in the order the trace first touches them.
+  // Reads the trace once and keeps one bit per block.
+  std::vector<std::vector<int> > GetFirstTouches(
+    const std::vector<std::unique_ptr<Texture> > &textures) const;
+
+ private:
+  Trace(const char *data, size_t size, bool is_csv);
+
+  bool NextRecord(const char **cursor, TraceRecord *rec, bool *ok) const;
+
+  const char *_data;
+  size_t _size;
+  bool _is_csv;
+};
+
+#endif  // __TRACE_H__